@@ -51,6 +51,12 @@ int PopFromBuffer(struct buffer *buf) {
     return next;
 }
 
+int GetBufferCount(struct buffer *buf) {
+    if (buf->empty) return 0;
+    if (buf->full) return buf->size;
+    return (buf->in - buf->out + buf->size) % buf->size;
+}
+
 void PrintBuffer(struct buffer *buf) {
     int i;
     if (buf->out < buf->in) {
@@ -49,6 +49,13 @@ void PushToBuffer(struct buffer *buf, int i);
  * @return the character that was popped
  */
 int PopFromBuffer(struct buffer *buf);
+
+/**
+ * Counts the values waiting in the buffer
+ * @param buf Buffer to count
+ * @return Number of values that can be popped
+ */
+int GetBufferCount(struct buffer *buf);
 /**
  * Prints out the contents of the buffer
  * @param buf Buffer to print
@@ -5,88 +5,158 @@
 #include <comp421/yalnix.h>
 #include <string.h>
 #include "yfs.h"
+#include "hash.h"
+#include "policy.h"
+#include "mrc.h"
+#include "victim.h"
 #include <assert.h>
 #define DEBUG 0
 
 int inode_count;
 int block_count;
-struct block_cache* block_stack; /* Cache for recently accessed blocks */
+struct block_cache* block_stacks[BLOCK_CLASSES]; /* Caches for recently accessed blocks, one per block class */
+struct block_cache* pinned_blocks; /* Blocks of files pinned by PinFile, NULL if no space is reserved */
 struct inode_cache* inode_stack; /* Cache for recently accessed inodes */
+int disk_reads; /* Sectors read by the server, see ReadDiskSector */
+int disk_writes; /* Sectors written by the server, see WriteDiskSector */
+int record_lookups; /* Whether block lookups go into the miss ratio curves, set while a handler runs */
+
+/**
+ * Reads a sector and counts it in disk_reads. The server reads the disk
+ * only through this, so MSG_STATS reports all of its I/O.
+ * @return Result of ReadSector
+ */
+int ReadDiskSector(int sector_num, void* buf) {
+    disk_reads++;
+    return ReadSector(sector_num, buf);
+}
+
+/**
+ * Writes a sector and counts it in disk_writes
+ * @return Result of WriteSector
+ */
+int WriteDiskSector(int sector_num, void* buf) {
+    disk_writes++;
+    return WriteSector(sector_num, buf);
+}
 
 /*********************
  * Inode Cache Code *
  ********************/
 /**
- * Creates a new Cache for Inodes
+ * Creates a new Cache for Inodes. Entries and the inode copies they own are
+ * allocated up front, one of each per cache slot.
+ * @param num_inodes Number of inodes in the file system
+ * @param capacity Maximum number of inodes the cache holds
  * @return Newly created cache
  */
-struct inode_cache *CreateInodeCache(int num_inodes) {
+struct inode_cache *CreateInodeCache(int num_inodes, int capacity) {
     inode_count = num_inodes;
     struct inode_cache *new_cache = malloc(sizeof(struct inode_cache));
     new_cache->stack_size = 0;
-    new_cache->hash_set = calloc((num_inodes/8) + 1, sizeof(struct inode_cache_entry));
-    new_cache->hash_size = (num_inodes/8) + 1;
+    new_cache->capacity = capacity;
+    new_cache->hash_size = GetHashSize(capacity);
+    new_cache->hash_set = calloc(new_cache->hash_size, sizeof(struct inode_cache_entry*));
+    new_cache->dirty_list = NULL;
+    new_cache->hits = 0;
+    new_cache->misses = 0;
+    new_cache->evictions = 0;
+    new_cache->writebacks = 0;
+    new_cache->fills = 0;
+    new_cache->entries = calloc(capacity, sizeof(struct inode_cache_entry));
+    new_cache->copies = calloc(capacity, sizeof(struct inode));
     inode_stack = new_cache;
-    struct inode* dummy_inode = malloc(sizeof(struct inode));
     int i;
-    for (i = -1; i >= -1 * INODE_CACHESIZE; i--) {
-        AddToInodeCache(new_cache, dummy_inode, i);
+    for (i = -1; i >= -1 * capacity; i--) {
+        AddToInodeCache(new_cache, NULL, i);
     }
     return new_cache;
 }
 
 /**
- * Adds a new inode to the top of the cache entry
+ * Private helper that takes an entry out of the inode cache's hash table
  */
-void AddToInodeCache(struct inode_cache *stack, struct inode *inode, int inum) {
-    if (stack->stack_size == INODE_CACHESIZE) {
-        /**If the stack is full, the base is de-allocated and the pointers to it are nullified */
-        struct inode_cache_entry *entry = stack->base;
-        int old_index = HashIndex(entry->inum);
-        int new_index = HashIndex(inum);
+void UnhashInode(struct inode_cache *stack, struct inode_cache_entry *entry) {
+    int old_index = HashIndex(entry->inum, stack->hash_size);
+    if (entry->prev_hash != NULL && entry->next_hash != NULL) {
+        /**Both Neighbors aren't Null*/
+        entry->next_hash->prev_hash = entry->prev_hash;
+        entry->prev_hash->next_hash = entry->next_hash;
+    } else if (entry->prev_hash == NULL && entry->next_hash != NULL) {
+        /**Tail End of Hash Table Array*/
+        stack->hash_set[old_index] = entry->next_hash;
+        entry->next_hash->prev_hash = NULL;
+    } else if (entry->prev_hash != NULL && entry->next_hash == NULL) {
+        /**Head of Hash Table Array*/
+        entry->prev_hash->next_hash = NULL;
+    } else {
+        /**No Neighbors in Hash Table Array*/
+        stack->hash_set[old_index] = NULL;
+    }
+}
 
-        /**Reassign Base*/
-        stack->base = stack->base->prev_lru;
-        stack->base->next_lru = NULL;
+/**
+ * Private helper that files a recycled entry under inum in the hash table
+ */
+void HashInode(struct inode_cache *stack, struct inode_cache_entry *entry, int inum) {
+    int new_index = HashIndex(inum, stack->hash_size);
+    entry->inum = inum;
+    entry->prev_hash = NULL;
+    if (stack->hash_set[new_index] != NULL) {
+        stack->hash_set[new_index]->prev_hash = entry;
+    }
+    entry->next_hash = stack->hash_set[new_index];
+    stack->hash_set[new_index] = entry;
+}
+
+/**
+ * Private helper that takes an entry out of the inode cache's LRU stack
+ */
+void UnlinkInode(struct inode_cache *stack, struct inode_cache_entry *entry) {
+    if (entry->prev_lru != NULL) entry->prev_lru->next_lru = entry->next_lru;
+    else stack->top = entry->next_lru;
+    if (entry->next_lru != NULL) entry->next_lru->prev_lru = entry->prev_lru;
+    else stack->base = entry->prev_lru;
+}
+
+/**
+ * Adds a new inode to the top of the cache entry. The entry keeps its own
+ * copy of the inode, since the block it was read from may be recycled.
+ * @param inode Inode to copy into the entry, or NULL to let the caller fill it
+ * @return The entry now holding inum
+ */
+struct inode_cache_entry* AddToInodeCache(struct inode_cache *stack, struct inode *inode, int inum) {
+    if (stack->stack_size == stack->capacity) {
+        /**If the stack is full, the least recently used entry no handler pins is recycled */
+        struct inode_cache_entry *entry = stack->base;
+        while (entry != NULL && entry->pin_count > 0) entry = entry->prev_lru;
+        assert(entry != NULL);
+        UnlinkInode(stack, entry);
 
         /** Write Back the Inode if it is dirty to avoid losing data*/
+        if (entry->inum > 0) stack->evictions++;
         if (entry->dirty && entry->inum > 0) WriteBackInode(entry);
-        if (entry->prev_hash != NULL && entry->next_hash != NULL) {
-            /**Both Neighbors aren't Null*/
-            entry->next_hash->prev_hash = entry->prev_hash;
-            entry->prev_hash->next_hash = entry->next_hash;
-        } else if (entry->prev_hash == NULL && entry->next_hash != NULL) {
-            /**Tail End of Hash Table Array*/
-            stack->hash_set[old_index] = entry->next_hash;
-            entry->next_hash->prev_hash = NULL;
-        } else if (entry->prev_hash != NULL && entry->next_hash == NULL) {
-            /**Head of Hash Table Array*/
-            entry->prev_hash->next_hash = NULL;
-        } else {
-            /**No Neighbors in Hash Table Array*/
-            stack->hash_set[old_index] = NULL;
-        }
-        entry->inode = inode;
+        UnhashInode(stack, entry);
+        if (inode != NULL) memcpy(entry->inode, inode, sizeof(struct inode));
         entry->dirty = 0;
-        entry->inum = inum;
         entry->prev_lru = NULL;
         entry->next_lru = stack->top;
-        stack->top->prev_lru = entry;
+        if (stack->top != NULL) stack->top->prev_lru = entry;
+        else stack->base = entry;
         stack->top = entry;
-        entry->prev_hash = NULL;
-        if (stack->hash_set[new_index] != NULL) {
-            stack->hash_set[new_index]->prev_hash = entry;
-        }
-        entry->next_hash = stack->hash_set[new_index];
-        stack->hash_set[new_index] = entry;
+        HashInode(stack, entry, inum);
+        return entry;
     } else {
-        /** Create a Cache Entry for the Inode*/
-        struct inode_cache_entry* item = malloc(sizeof(struct inode_cache_entry));
-        int index = HashIndex(inum);
+        /** Take the next unused entry and its inode copy */
+        struct inode_cache_entry* item = &stack->entries[stack->stack_size];
+        int index = HashIndex(inum, stack->hash_size);
         item->inum = inum;
-        item->inode = inode;
+        item->inode = &stack->copies[stack->stack_size];
+        if (inode != NULL) memcpy(item->inode, inode, sizeof(struct inode));
+        item->dirty = 0;
         item->prev_hash = NULL;
         item->prev_lru = NULL;
+        item->next_lru = NULL;
 
         /** If hash already exists, enqueue item in the hash linked list */
         if (stack->hash_set[index] != NULL) {
@@ -109,9 +179,58 @@ void AddToInodeCache(struct inode_cache *stack, struct inode *inode, int inum) {
 
         /**If the stack isn't full increase the size*/
         stack->stack_size++;
+        return item;
     }
 }
 
+/**
+ * Adds an inode at the least recently used end of a full cache, above the
+ * skip entries already there. The first unpinned entry above those is
+ * recycled, so adding several inodes this way evicts the coldest entries
+ * only and never one of the inodes added before or one a handler holds.
+ * @param inode Inode to copy into the entry
+ * @param skip Number of entries at the base to keep
+ * @return 1 if the inode was added, 0 if every other entry is pinned
+ */
+int AddToInodeCacheBase(struct inode_cache *stack, struct inode *inode, int inum, int skip) {
+    struct inode_cache_entry *entry = stack->base;
+    while (skip-- > 0) entry = entry->prev_lru;
+    while (entry != NULL && entry->pin_count > 0) entry = entry->prev_lru;
+    if (entry == NULL) return 0;
+
+    if (entry->inum > 0) stack->evictions++;
+    if (entry->dirty && entry->inum > 0) WriteBackInode(entry);
+    UnhashInode(stack, entry);
+
+    /** Unlink the entry, then put it back under the ones it was above */
+    UnlinkInode(stack, entry);
+    entry->prev_lru = stack->base;
+    entry->next_lru = NULL;
+    if (stack->base != NULL) stack->base->next_lru = entry;
+    else stack->top = entry;
+    stack->base = entry;
+
+    memcpy(entry->inode, inode, sizeof(struct inode));
+    entry->dirty = 0;
+    HashInode(stack, entry, inum);
+    return 1;
+}
+
+/**
+ * Keeps an inode in the cache while a handler holds its entry. A handler
+ * that holds on to an inode while calling GetInode again must pin it first,
+ * otherwise the nested miss, or the neighbours it fills in, may recycle the
+ * entry for another inode. Every PinInode must be matched by an UnpinInode.
+ */
+void PinInode(struct inode_cache_entry* entry) {
+    entry->pin_count++;
+}
+
+void UnpinInode(struct inode_cache_entry* entry) {
+    assert(entry->pin_count > 0);
+    entry->pin_count--;
+}
+
 /**
  * Searches up an inode within a cache
  * @param stack Cache to look for the inode in
@@ -121,7 +240,7 @@ void AddToInodeCache(struct inode_cache *stack, struct inode *inode, int inum) {
 struct inode_cache_entry* LookUpInode(struct inode_cache *stack, int inum) {
     struct inode_cache_entry* ice;
     /**For loop iterating into the hash array index the inode number points to*/
-    for (ice = stack->hash_set[HashIndex(inum)]; ice != NULL; ice = ice->next_hash) {
+    for (ice = stack->hash_set[HashIndex(inum, stack->hash_size)]; ice != NULL; ice = ice->next_hash) {
         if (ice->inum == inum) {
             RaiseInodeCachePosition(stack, ice);
             return ice;
@@ -132,17 +251,54 @@ struct inode_cache_entry* LookUpInode(struct inode_cache *stack, int inum) {
 }
 
 /**
- *
- * @param out Inode that was pushed out of the cache
+ * Private helper that finds a cached inode without touching its position
+ */
+struct inode_cache_entry* FindInode(struct inode_cache *stack, int inum) {
+    struct inode_cache_entry* ice;
+    for (ice = stack->hash_set[HashIndex(inum, stack->hash_size)]; ice != NULL; ice = ice->next_hash) {
+        if (ice->inum == inum) return ice;
+    }
+    return NULL;
+}
+
+/**
+ * Marks a cached inode as modified and puts it on the dirty list
+ */
+void MarkInodeDirty(struct inode_cache_entry* entry) {
+    if (entry->dirty) return;
+    entry->dirty = 1;
+    entry->prev_dirty = NULL;
+    entry->next_dirty = inode_stack->dirty_list;
+    if (entry->next_dirty != NULL) entry->next_dirty->prev_dirty = entry;
+    inode_stack->dirty_list = entry;
+}
+
+/**
+ * Copies a dirty inode into its inode block. Every other dirty inode cached
+ * from the same block is copied along with it, so the block is fetched and
+ * dirtied once for all of them. They are all taken off the dirty list.
+ * @param out Inode that was pushed out of the cache, or is being synced
  */
 void WriteBackInode(struct inode_cache_entry* out) {
     if (DEBUG) printf("Inode %d evicted, syncing\n",out->inum);
-    struct block_cache_entry* inode_block_entry = GetBlock((out->inum / 8) + 1);
-    void* inode_block = inode_block_entry->block;
-    struct inode* overwrite = (struct inode *)inode_block + (out->inum % 8);
-    inode_block_entry->dirty = 1;
-    memcpy(overwrite, out->inode, sizeof(struct inode));
-    out->dirty = 0;
+    int first_inum = (out->inum / INODE_PER_BLOCK) * INODE_PER_BLOCK;
+    struct block_cache_entry* inode_block_entry = GetBlock(out->inum / INODE_PER_BLOCK + 1, BLOCK_METADATA);
+    struct inode* inode_block = inode_block_entry->block;
+    struct inode_cache_entry* entry;
+    int i;
+
+    MarkBlockDirty(inode_block_entry);
+    for (i = 0; i < INODE_PER_BLOCK; i++) {
+        entry = FindInode(inode_stack, first_inum + i);
+        if (entry == NULL || !entry->dirty) continue;
+
+        memcpy(inode_block + i, entry->inode, sizeof(struct inode));
+        inode_stack->writebacks++;
+        entry->dirty = 0;
+        if (entry->prev_dirty != NULL) entry->prev_dirty->next_dirty = entry->next_dirty;
+        else inode_stack->dirty_list = entry->next_dirty;
+        if (entry->next_dirty != NULL) entry->next_dirty->prev_dirty = entry->prev_dirty;
+    }
 }
 
 /**
@@ -174,6 +330,35 @@ void RaiseInodeCachePosition(struct inode_cache* stack, struct inode_cache_entry
     }
 }
 
+/**
+ * Private helper that caches the live inodes sharing an inode block with a
+ * missed inode, so scans over consecutive inodes take one miss per block.
+ * They go in at the least recently used end, and a miss recycles at most
+ * INODE_FILL_MAX entries for them, the coldest unpinned ones, and never more
+ * than half of a small cache. Inodes that are already cached are skipped,
+ * their copies may be dirty.
+ */
+void FillInodeNeighbors(struct inode* inode_block, int inum) {
+    int first_inum = (inum / INODE_PER_BLOCK) * INODE_PER_BLOCK;
+    int limit = INODE_FILL_MAX;
+    int filled = 0;
+    int neighbor;
+    int i;
+
+    if (limit > inode_stack->capacity / 2) limit = inode_stack->capacity / 2;
+    for (i = 0; i < INODE_PER_BLOCK && filled < limit; i++) {
+        neighbor = first_inum + i;
+        /** Slot 0 of the first block is the file system header */
+        if (neighbor == inum || neighbor < 1 || neighbor > inode_count) continue;
+        if (inode_block[i].type == INODE_FREE) continue;
+        if (FindInode(inode_stack, neighbor) != NULL) continue;
+
+        if (!AddToInodeCacheBase(inode_stack, inode_block + i, neighbor, filled)) return;
+        inode_stack->fills++;
+        filled++;
+    }
+}
+
 /**
  * Searches for and returns the inode based on the number given
  * @param inode_num The inode being requested
@@ -185,14 +370,28 @@ struct inode_cache_entry* GetInode(int inum) {
 
     /** First Check the Inode Cache */
     struct inode_cache_entry* current = LookUpInode(inode_stack, inum);
-    if (current != NULL) return current;
+    if (current != NULL) {
+        inode_stack->hits++;
+        return current;
+    }
+    inode_stack->misses++;
+
+    /**
+     * Make room in the Inode Cache first, since writing back the evicted
+     * inode may itself go through the Block Cache and recycle a buffer
+     */
+    current = AddToInodeCache(inode_stack, NULL, inum);
 
-    /** If it's not in the Inode Cache, check the Block */
-    void* inode_block = GetBlock((inum / 8) + 1)->block;
+    /** Then copy the inode out of its Block */
+    struct block_cache_entry* inode_block_entry = GetBlock(inum / INODE_PER_BLOCK + 1, BLOCK_METADATA);
+    struct inode* inode_block = inode_block_entry->block;
+    memcpy(current->inode, inode_block + inum % INODE_PER_BLOCK, sizeof(struct inode));
 
-    /** Add inode to cache, when accessed*/
-    AddToInodeCache(inode_stack, (struct inode *)inode_block + (inum % 8), inum);
-    return inode_stack->top;
+    /** The block is at hand, cache the other live inodes in it too */
+    PinBlock(inode_block_entry);
+    FillInodeNeighbors(inode_block, inum);
+    UnpinBlock(inode_block_entry);
+    return current;
 }
 
 void PrintInodeCacheHashSet(struct inode_cache* stack) {
@@ -220,88 +419,270 @@ void PrintInodeCacheStack(struct inode_cache* stack) {
  * Block Cache Code *
  ********************/
 /**
- * Creates new LIFO Cache for blocks
+ * Creates new Cache for one class of blocks. Every block buffer the cache
+ * will ever use is carved out of one sector aligned arena here, so cache
+ * misses never have to allocate memory.
+ * @param num_blocks Number of blocks in the file system
+ * @param capacity Maximum number of blocks the cache holds
+ * @param policy Replacement policy deciding which block is evicted
+ * @param block_class BLOCK_METADATA or BLOCK_DATA, the partition this cache
+ * serves, or BLOCK_PINNED for the space reserved for pinned files
  */
-struct block_cache *CreateBlockCache(int num_blocks) {
+struct block_cache *CreateBlockCache(int num_blocks, int capacity, struct replacement_policy* policy, int block_class) {
     block_count = num_blocks;
     struct block_cache *new_cache = malloc(sizeof(struct block_cache));
     new_cache->stack_size = 0;
-    new_cache->hash_set = calloc((num_blocks/8) + 1, sizeof(struct block_cache_entry));
-    new_cache->hash_size = (num_blocks/8) + 1;
-    block_stack = new_cache;
+    new_cache->capacity = capacity;
+    new_cache->hash_size = GetHashSize(capacity);
+    new_cache->hash_set = calloc(new_cache->hash_size, sizeof(struct block_cache_entry*));
+    new_cache->entries = calloc(capacity, sizeof(struct block_cache_entry));
+
+    /** Over-allocate by one sector so the first buffer can be aligned */
+    new_cache->arena = malloc((capacity + 1) * SECTORSIZE);
+    new_cache->buffers = (char *)(((unsigned long)new_cache->arena + SECTORSIZE - 1) & ~(unsigned long)(SECTORSIZE - 1));
+    new_cache->dirty_count = 0;
+    new_cache->dirty_high = capacity * DIRTY_HIGH_PERCENT / 100;
+    new_cache->dirty_low = capacity * DIRTY_LOW_PERCENT / 100;
+    new_cache->dirty_list = NULL;
+    new_cache->sync_order = malloc(capacity * sizeof(struct block_cache_entry*));
+    new_cache->last_sync_sectors = 0;
+    new_cache->last_sync_runs = 0;
+    new_cache->total_sync_sectors = 0;
+    new_cache->total_sync_runs = 0;
+    new_cache->hits = 0;
+    new_cache->misses = 0;
+    new_cache->installs = 0;
+    new_cache->evictions = 0;
+    new_cache->writebacks = 0;
+    new_cache->prefetches = 0;
+    new_cache->prefetch_hits = 0;
+    new_cache->prefetch_wasted = 0;
+    new_cache->free_entries = NULL;
+    new_cache->mrc = CreateMissRatioCurve(capacity);
+    InitReplacementPolicy(new_cache, policy);
+    if (block_class == BLOCK_PINNED) pinned_blocks = new_cache;
+    else block_stacks[block_class] = new_cache;
     return new_cache;
 }
 
 /**
- * Adds a new inode to the top of the cache entry
+ * Private helper that takes an entry out of the cache's hash table
  */
-void AddToBlockCache(struct block_cache *stack, void* block, int block_number) {
-    if (stack->stack_size == BLOCK_CACHESIZE) {
-        /**If the stack is full, the base is de-allocated and the pointers to it are nullified */
-        struct block_cache_entry *entry = stack->base;
-        int old_index = HashIndex(entry->block_number);
-        int new_index = HashIndex(block_number);
+void UnhashBlock(struct block_cache *stack, struct block_cache_entry *entry) {
+    int old_index = HashIndex(entry->block_number, stack->hash_size);
+    if (entry->prev_hash != NULL && entry->next_hash != NULL) {
+        /**Both Neighbors aren't Null*/
+        entry->next_hash->prev_hash = entry->prev_hash;
+        entry->prev_hash->next_hash = entry->next_hash;
+    } else if(entry->prev_hash == NULL && entry->next_hash != NULL) {
+        /**Tail End of Hash Table Array*/
+        stack->hash_set[old_index] = entry->next_hash;
+        entry->next_hash->prev_hash = NULL;
+    } else if(entry->prev_hash != NULL && entry->next_hash == NULL) {
+        /**Head of Hash Table Array*/
+        entry->prev_hash->next_hash = NULL;
+    } else {
+        /**No Neighbors in Hash Table Array*/
+        stack->hash_set[old_index] = NULL;
+    }
+}
 
-        /**Reassign Base*/
-        stack->base = stack->base->prev_lru;
-        stack->base->next_lru = NULL;
+/**
+ * Adds a block number to the cache and returns its entry. The entry's buffer
+ * is the buffer of the entry the replacement policy evicted, of an entry
+ * RemoveFromBlockCache freed, or the next unused arena buffer, so its
+ * contents must be filled in by the caller.
+ */
+struct block_cache_entry* AddToBlockCache(struct block_cache *stack, int block_number) {
+    struct block_cache_entry *entry;
+    int list = stack->policy->miss(stack, block_number);
+    int new_index = HashIndex(block_number, stack->hash_size);
+
+    if (stack->stack_size == stack->capacity) {
+        /**If the cache is full, the policy's victim is recycled and the pointers to it are nullified */
+        entry = stack->policy->victim(stack, list);
+        stack->evictions++;
+        if (entry->prefetched) stack->prefetch_wasted++;
 
         /** Write Back the Block if it is dirty to avoid losing data*/
         if (entry->dirty && entry->block_number > 0) {
             if (DEBUG) printf("Writing block to sector: %d\n", entry->block_number);
-            WriteSector(entry->block_number, entry->block);
-        }
-        if (entry->prev_hash != NULL && entry->next_hash != NULL) {
-            /**Both Neighbors aren't Null*/
-            entry->next_hash->prev_hash = entry->prev_hash;
-            entry->prev_hash->next_hash = entry->next_hash;
-        } else if(entry->prev_hash == NULL && entry->next_hash != NULL) {
-            /**Tail End of Hash Table Array*/
-            stack->hash_set[old_index] = entry->next_hash;
-            entry->next_hash->prev_hash = NULL;
-        } else if(entry->prev_hash != NULL && entry->next_hash == NULL) {
-            /**Head of Hash Table Array*/
-            entry->prev_hash->next_hash = NULL;
-        } else {
-            /**No Neighbors in Hash Table Array*/
-            stack->hash_set[old_index] = NULL;
+            WriteBackBlock(entry);
         }
-        entry->block = block;
-        entry->dirty = 0;
-        entry->block_number = block_number;
-        entry->prev_lru = NULL;
-        entry->next_lru = stack->top;
-        stack->top->prev_lru = entry;
-        stack->top = entry;
-        entry->prev_hash = NULL;
-        if(stack->hash_set[new_index] != NULL) stack->hash_set[new_index]->prev_hash = entry;
-        entry->next_hash = stack->hash_set[new_index];
-        stack->hash_set[new_index] = entry;
+        /** The block now matches its sector, keep it compressed in case it is wanted again */
+        if (victim_cache != NULL && entry->block_number > 0) AddVictim(victim_cache, entry->block_number, entry->block);
+        UnhashBlock(stack, entry);
+        /** entry->block is kept, the evicted buffer is reused for the new block */
+    } else if (stack->free_entries != NULL) {
+        /** Reuse an entry RemoveFromBlockCache gave up, with its buffer */
+        entry = stack->free_entries;
+        stack->free_entries = entry->next_lru;
+        stack->stack_size++;
     } else {
-        /** Create a Cache Entry for the Inode*/
-        struct block_cache_entry* item = malloc(sizeof(struct inode_cache_entry));
-        item->block_number = block_number;
-        item->block = block;
-        int index = HashIndex(block_number);
-        if(stack->hash_set[index] != NULL) stack->hash_set[index]->prev_hash = item;
-        item->next_hash = stack->hash_set[index];
-        item->prev_hash = NULL;
-        item->prev_lru = NULL;
-        stack->hash_set[index] = item;
-        /** Place entry into the LRU Stack*/
-        if (!stack->stack_size) {
-            /** If the stack is empty the entry becomes both the top and base*/
-            stack->base = item;
-            stack->top = item;
-        } else {
-            /** If the stack isn't empty the entry is added to the top*/
-            item->next_lru = stack->top;
-            stack->top->prev_lru = item;
-            stack->top = item;
-        }
-        /**If the stack isn't full increase the size*/
+        /** Take the next unused entry and its buffer from the arena */
+        entry = &stack->entries[stack->stack_size];
+        entry->block = stack->buffers + stack->stack_size * SECTORSIZE;
+        entry->cache = stack;
+        /**If the cache isn't full increase the size*/
         stack->stack_size++;
     }
+
+    entry->dirty = 0;
+    entry->prefetched = 0;
+    entry->block_number = block_number;
+    entry->prev_hash = NULL;
+    if(stack->hash_set[new_index] != NULL) stack->hash_set[new_index]->prev_hash = entry;
+    entry->next_hash = stack->hash_set[new_index];
+    stack->hash_set[new_index] = entry;
+    PushToBlockList(stack, entry, list);
+    return entry;
+}
+
+/**
+ * Takes an entry out of the cache without writing it back, freeing its slot
+ * for the next block added. Used to move a block to another partition, the
+ * caller copies the contents and dirty state first.
+ */
+void RemoveFromBlockCache(struct block_cache *stack, struct block_cache_entry *entry) {
+    assert(entry->pin_count == 0);
+    UnhashBlock(stack, entry);
+    RemoveFromBlockList(stack, entry);
+    if (entry->dirty) {
+        entry->dirty = 0;
+        if (entry->prev_dirty != NULL) entry->prev_dirty->next_dirty = entry->next_dirty;
+        else stack->dirty_list = entry->next_dirty;
+        if (entry->next_dirty != NULL) entry->next_dirty->prev_dirty = entry->prev_dirty;
+        stack->dirty_count--;
+    }
+    entry->block_number = -1;
+    entry->next_lru = stack->free_entries;
+    stack->free_entries = entry;
+    stack->stack_size--;
+}
+
+/**
+ * Keeps a block in the cache while its buffer is in use. A handler that holds
+ * on to a block while calling GetBlock again must pin it first, otherwise
+ * the nested miss may evict it and read another sector into the buffer.
+ * Every PinBlock must be matched by an UnpinBlock.
+ */
+void PinBlock(struct block_cache_entry* entry) {
+    entry->pin_count++;
+}
+
+void UnpinBlock(struct block_cache_entry* entry) {
+    assert(entry->pin_count > 0);
+    entry->pin_count--;
+    /** A block freed while a handler held it may be left reserved with no file pinning it */
+    if (entry->pin_count == 0 && entry->cache == pinned_blocks && entry->file_pins == 0) UnpinCachedBlock(entry);
+}
+
+/**
+ * Marks a cached block as modified so it is written back before it is evicted
+ */
+void MarkBlockDirty(struct block_cache_entry* entry) {
+    if (entry->dirty) return;
+    entry->dirty = 1;
+    entry->prev_dirty = NULL;
+    entry->next_dirty = entry->cache->dirty_list;
+    if (entry->next_dirty != NULL) entry->next_dirty->prev_dirty = entry;
+    entry->cache->dirty_list = entry;
+    entry->cache->dirty_count++;
+}
+
+/**
+ * Writes a dirty block to its sector, marks it clean and takes it off the
+ * dirty list
+ * @param out Block to write back
+ */
+void WriteBackBlock(struct block_cache_entry* out) {
+    WriteDiskSector(out->block_number, out->block);
+    out->cache->writebacks++;
+    out->dirty = 0;
+    if (out->prev_dirty != NULL) out->prev_dirty->next_dirty = out->next_dirty;
+    else out->cache->dirty_list = out->next_dirty;
+    if (out->next_dirty != NULL) out->next_dirty->prev_dirty = out->prev_dirty;
+    out->cache->dirty_count--;
+}
+
+/**
+ * Called between requests. Once more than dirty_high blocks are dirty, the
+ * oldest dirty blocks of each list are written back until only dirty_low
+ * remain, so that evictions on later misses find clean blocks and do not
+ * have to write.
+ */
+void FlushDirtyBlocks(struct block_cache* stack) {
+    struct block_cache_entry* entry;
+    int list;
+    if (stack->dirty_count <= stack->dirty_high) return;
+
+    for (list = 0; list < BLOCK_LISTS; list++) {
+        for (entry = stack->lists[list].base; entry != NULL; entry = entry->prev_lru) {
+            if (stack->dirty_count <= stack->dirty_low) return;
+            if (entry->dirty) {
+                if (DEBUG) printf("Flushing block: %d\n", entry->block_number);
+                WriteBackBlock(entry);
+            }
+        }
+    }
+}
+
+/**
+ * Writes back up to max of the oldest dirty blocks, whatever the watermarks
+ * say. Used while the server is idle, so later misses and syncs find the
+ * cache clean.
+ * @return Number of blocks written
+ */
+int CleanDirtyBlocks(struct block_cache* stack, int max) {
+    struct block_cache_entry* entry;
+    int written = 0;
+    int list;
+
+    for (list = 0; list < BLOCK_LISTS; list++) {
+        for (entry = stack->lists[list].base; entry != NULL && written < max; entry = entry->prev_lru) {
+            if (entry->dirty) {
+                WriteBackBlock(entry);
+                written++;
+            }
+        }
+    }
+    return written;
+}
+
+/**
+ * Orders block entries by block number for qsort
+ */
+int CompareBlockNumbers(const void* a, const void* b) {
+    return (*(struct block_cache_entry* const*)a)->block_number - (*(struct block_cache_entry* const*)b)->block_number;
+}
+
+/**
+ * Writes back every dirty block in ascending sector order, so the disk head
+ * sweeps once across the disk instead of following recency order. Only the
+ * dirty list is visited. Sectors that follow each other are counted as one
+ * run, last_sync_sectors and last_sync_runs record what the call wrote and
+ * the totals add it up for MSG_STATS.
+ */
+void SyncDirtyBlocks(struct block_cache* stack) {
+    struct block_cache_entry* entry;
+    int count = 0;
+    int runs = 0;
+    int i;
+
+    for (entry = stack->dirty_list; entry != NULL; entry = entry->next_dirty) {
+        stack->sync_order[count++] = entry;
+    }
+    qsort(stack->sync_order, count, sizeof(struct block_cache_entry*), CompareBlockNumbers);
+
+    for (i = 0; i < count; i++) {
+        if (i == 0 || stack->sync_order[i]->block_number != stack->sync_order[i - 1]->block_number + 1) runs++;
+        WriteBackBlock(stack->sync_order[i]);
+    }
+
+    stack->last_sync_sectors = count;
+    stack->last_sync_runs = runs;
+    stack->total_sync_sectors += count;
+    stack->total_sync_runs += runs;
 }
 
 /**
@@ -313,7 +694,7 @@ void AddToBlockCache(struct block_cache *stack, void* block, int block_number) {
 struct block_cache_entry* LookUpBlock(struct block_cache *stack, int block_number) {
     struct block_cache_entry* block;
     /**For loop iterating into the hash array index the inode number points to*/
-    for (block = stack->hash_set[HashIndex(block_number)]; block != NULL; block = block->next_hash) {
+    for (block = stack->hash_set[HashIndex(block_number, stack->hash_size)]; block != NULL; block = block->next_hash) {
         if (block->block_number == block_number) {
             RaiseBlockCachePosition(stack,block);
             return block;
@@ -324,31 +705,92 @@ struct block_cache_entry* LookUpBlock(struct block_cache *stack, int block_numbe
 }
 
 /**
- * Repositions block at top of stack whenever used
+ * Private helper that finds a cached block without touching its position
  */
-void RaiseBlockCachePosition(struct block_cache *stack, struct block_cache_entry* recent_access) {
-    if ((recent_access->block_number == stack->top->block_number) || (recent_access->prev_lru == NULL && recent_access->next_lru == NULL)) return;
-    if (recent_access->block_number == stack->base->block_number) {
-        /**Reassign Base*/
-        recent_access->prev_lru->next_lru = NULL;
-        stack->base = recent_access->prev_lru;
+struct block_cache_entry* FindBlock(struct block_cache *stack, int block_number) {
+    struct block_cache_entry* block;
+    for (block = stack->hash_set[HashIndex(block_number, stack->hash_size)]; block != NULL; block = block->next_hash) {
+        if (block->block_number == block_number) return block;
+    }
+    return NULL;
+}
 
-        /**Reassign Top*/
-        recent_access->next_lru = stack->top;
-        stack->top->prev_lru = recent_access;
-        stack->top = recent_access;
-    } else {
-        /**Reassign Neighbors*/
-        recent_access->next_lru->prev_lru = recent_access->prev_lru;
-        recent_access->prev_lru->next_lru = recent_access->next_lru;
+/**
+ * Moves a block to the least recently used end of the list it is on, so
+ * the policy evicts it before the other blocks of that list. Blocks in the
+ * reserved partition are left alone.
+ */
+void DemoteBlock(struct block_cache_entry* entry) {
+    if (entry->cache == pinned_blocks) return;
+    RemoveFromBlockList(entry->cache, entry);
+    AppendToBlockList(entry->cache, entry, entry->list);
+}
 
-        /**Reassign Top*/
-        recent_access->next_lru = stack->top;
-        stack->top->prev_lru = recent_access;
-        stack->top = recent_access;
+/**
+ * Demotes a block if either partition holds it, without reading it otherwise
+ */
+void DemoteCachedBlock(int block_num) {
+    struct block_cache_entry *entry;
+    int i;
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        entry = FindBlock(block_stacks[i], block_num);
+        if (entry != NULL) DemoteBlock(entry);
     }
 }
 
+/**
+ * Forgets a block that was just freed. Its cached copy is dropped without
+ * being written back, since nothing will read it before it is reallocated,
+ * and its slot is free for the next block. That includes the reserved
+ * partition: the files that pinned the block no longer hold it. Blocks a
+ * handler has pinned are left alone, see UnpinBlock.
+ */
+void DropCachedBlock(int block_num) {
+    struct block_cache_entry *entry;
+    int i;
+    if (pinned_blocks != NULL && (entry = FindBlock(pinned_blocks, block_num)) != NULL) {
+        entry->file_pins = 0;
+        if (entry->pin_count == 0) RemoveFromBlockCache(pinned_blocks, entry);
+    }
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        entry = FindBlock(block_stacks[i], block_num);
+        if (entry != NULL && entry->pin_count == 0) RemoveFromBlockCache(block_stacks[i], entry);
+    }
+    if (victim_cache != NULL) DropVictim(victim_cache, block_num);
+}
+
+/**
+ * Returns the cached contents of a block without reading it, and without
+ * touching its position or any counter
+ * @return The block's buffer, or NULL if no partition holds the block
+ */
+void* PeekCachedBlock(int block_num) {
+    struct block_cache_entry *entry;
+    int i;
+    if (pinned_blocks != NULL && (entry = FindBlock(pinned_blocks, block_num)) != NULL) return entry->block;
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        entry = FindBlock(block_stacks[i], block_num);
+        if (entry != NULL) return entry->block;
+    }
+    return NULL;
+}
+
+/**
+ * Returns the cached copy of an inode the way PeekCachedBlock does
+ * @return The inode, or NULL if it is not cached
+ */
+struct inode* PeekCachedInode(int inum) {
+    struct inode_cache_entry *entry = FindInode(inode_stack, inum);
+    return entry != NULL ? entry->inode : NULL;
+}
+
+/**
+ * Lets the replacement policy reposition a block whenever it is used
+ */
+void RaiseBlockCachePosition(struct block_cache *stack, struct block_cache_entry* recent_access) {
+    stack->policy->hit(stack, recent_access);
+}
+
 
 void PrintBlockCacheHashSet(struct block_cache* stack) {
     int index;
@@ -365,95 +807,236 @@ void PrintBlockCacheHashSet(struct block_cache* stack) {
 }
 
 /**
- * Returns a block, either by searching the cache or reading its sector
- * @param block_num The number of the block being requested
- * @return Pointer to the data that the block encapsulates
+ * Private helper that finds a block in the reserved partition
+ * @return The block's entry, or NULL if it is not pinned
+ */
+struct block_cache_entry* LookUpPinnedBlock(int block_num) {
+    struct block_cache_entry *current;
+    if (pinned_blocks == NULL || pinned_blocks->stack_size == 0) return NULL;
+    current = LookUpBlock(pinned_blocks, block_num);
+    if (current != NULL) pinned_blocks->hits++;
+    return current;
+}
+
+/**
+ * Moves a block into the reserved partition, reading it if it is not cached.
+ * The caller makes sure the partition has room.
+ * @param block_class Partition the block goes back to when it is unpinned
+ * @return The block's entry in the reserved partition
+ */
+struct block_cache_entry* PinCachedBlock(int block_num, int block_class) {
+    struct block_cache_entry *entry = GetBlock(block_num, block_class);
+    struct block_cache_entry *pinned;
+    if (entry->cache == pinned_blocks) return entry;
+
+    assert(pinned_blocks->stack_size < pinned_blocks->capacity);
+    pinned = AddToBlockCache(pinned_blocks, block_num);
+    memcpy(pinned->block, entry->block, BLOCKSIZE);
+    pinned->block_class = block_class;
+    pinned->file_pins = 0;
+    if (entry->dirty) MarkBlockDirty(pinned);
+    RemoveFromBlockCache(entry->cache, entry);
+    return pinned;
+}
+
+/**
+ * Moves a block out of the reserved partition back to the partition of its
+ * class, where it is treated as just used
+ */
+void UnpinCachedBlock(struct block_cache_entry* entry) {
+    struct block_cache_entry *back = AddToBlockCache(block_stacks[entry->block_class], entry->block_number);
+    memcpy(back->block, entry->block, BLOCKSIZE);
+    if (entry->dirty) MarkBlockDirty(back);
+    RemoveFromBlockCache(pinned_blocks, entry);
+}
+
+/**
+ * Private helper that counts the first lookup of a prefetched block
+ * @param prefetched Set to 1 if it is that first lookup, may be NULL
  */
-struct block_cache_entry* GetBlock(int block_num) {
+struct block_cache_entry* UseBlock(struct block_cache_entry* entry, int *prefetched) {
+    if (entry->prefetched) {
+        entry->prefetched = 0;
+        entry->cache->prefetch_hits++;
+        if (prefetched != NULL) *prefetched = 1;
+    }
+    return entry;
+}
+
+/**
+ * Private helper behind GetBlock and GetBlockOnce
+ * @param installed Set to 1 if the block was not cached and had to be added,
+ * or was only cached because PrefetchBlock read it
+ */
+struct block_cache_entry* FetchBlock(int block_num, int block_class, int *installed) {
     /**Must be a valid block number */
     assert(block_num >= 1 && block_num <= block_count);
+    struct block_cache *stack = block_stacks[block_class];
+    struct block_cache *other = block_stacks[1 - block_class];
+    if (record_lookups) RecordBlockAccess(stack->mrc, block_num);
+
+    /** Blocks of pinned files are only ever in the reserved partition */
+    struct block_cache_entry *current = LookUpPinnedBlock(block_num);
+    if (current != NULL) return UseBlock(current, installed);
 
-    /** First Check Block Cache*/
-    struct block_cache_entry *current = LookUpBlock(block_stack,block_num);
+    /** Then Check the Block's own partition */
+    current = LookUpBlock(stack, block_num);
     if (DEBUG) printf("GetBlock: %d found: %d\n", block_num, current != NULL);
-    if (current != NULL) return current;
+    if (current != NULL) {
+        stack->hits++;
+        return UseBlock(current, installed);
+    }
+
+    /**
+     * A freed block may be reused with another class while its old copy is
+     * still cached in the other partition. That copy is the current one.
+     */
+    current = LookUpBlock(other, block_num);
+    if (current != NULL) {
+        other->hits++;
+        return UseBlock(current, installed);
+    }
+
+    /**
+     * Take the block out of the victim tier before making room, since the
+     * block evicted to make room may take its space in the tier
+     */
+    void *victim = victim_cache != NULL ? TakeVictim(victim_cache, block_num) : NULL;
+    current = AddToBlockCache(stack, block_num);
+    *installed = 1;
+    if (victim != NULL) {
+        memcpy(current->block, victim, BLOCKSIZE);
+        return current;
+    }
+
+   /** If not found anywhere, read directly from disk into the recycled buffer */
+    stack->misses++;
+    ReadDiskSector(block_num, current->block);
+    return current;
+}
+
+/**
+ * Returns a block, either by searching the cache or reading its sector
+ * @param block_num The number of the block being requested
+ * @param block_class BLOCK_METADATA for inode, directory and indirect blocks,
+ * BLOCK_DATA for file contents. Picks the partition a missed block goes to.
+ * @return Pointer to the data that the block encapsulates
+ */
+struct block_cache_entry* GetBlock(int block_num, int block_class) {
+    int installed = 0;
+    return FetchBlock(block_num, block_class, &installed);
+}
 
-   /** If not found in cache, read directly from disk */
-    void *block_buffer = malloc(SECTORSIZE);
-    ReadSector(block_num, block_buffer);
-    AddToBlockCache(block_stack, block_buffer, block_num);
-    return block_stack->top;
+/**
+ * Returns a block like GetBlock, but a block that was not cached, or was
+ * only read ahead, is left at the least recently used end of its list, so it
+ * is the next one evicted.
+ * For blocks that will be used once, like those of a file being streamed.
+ */
+struct block_cache_entry* GetBlockOnce(int block_num, int block_class) {
+    int installed = 0;
+    struct block_cache_entry *current = FetchBlock(block_num, block_class, &installed);
+    if (installed) DemoteBlock(current);
+    return current;
 }
 
 
 /**
- * Prints out the Block Cache as a stack
+ * Reads a block before a request needs it. A block that is already cached
+ * is left where it is, so only blocks actually read ahead are counted, and
+ * the first lookup that finds one counts as a prefetch hit. The read is not
+ * a lookup by a request, so it stays out of the miss ratio curve.
+ * @param block_class Class of the block, see GetBlock
+ * @return 1 if the block was brought into the cache, 0 if it was there
  */
- void PrintBlockCacheStack(struct block_cache* stack) {
-     struct block_cache_entry* position = stack->top;
-     while (position != NULL) {
-         printf("| %d |\n", position->block_number);
-         position = position->next_lru;
-     }
- }
+int PrefetchBlock(int block_num, int block_class) {
+    int installed = 0;
+    int recording = record_lookups;
+    struct block_cache_entry *current;
+    if (pinned_blocks != NULL && FindBlock(pinned_blocks, block_num) != NULL) return 0;
+    if (FindBlock(block_stacks[BLOCK_METADATA], block_num) != NULL) return 0;
+    if (FindBlock(block_stacks[BLOCK_DATA], block_num) != NULL) return 0;
 
-int HashIndex(int key_value) {
-    return key_value > 0 ? key_value/8 : key_value/(-8) ;
+    record_lookups = 0;
+    current = FetchBlock(block_num, block_class, &installed);
+    record_lookups = recording;
+    current->prefetched = 1;
+    current->cache->prefetches++;
+    return 1;
 }
 
-void TestInodeCache(int num_inodes) {
-    int i;
-    int inode_number;
-    struct inode* inode;
-    for(i = 1; i <= 64; i++) {
-        inode_number = (rand() % num_inodes)+1;
-        printf("Call %d: Calling Inode %d\n",i,inode_number);
-        inode = GetInode(inode_number)->inode;
-        printf("Inode Type: %d\n",inode->type);
-        printf("Cache Hash Table: \n");
-        PrintInodeCacheHashSet(inode_stack);
-        printf("Cache Stack\n");
-        PrintInodeCacheStack(inode_stack);
-        printf("Cache Size: %d\n",inode_stack->stack_size);
-    }
-    int j;
-    for(i = 1; i <= num_inodes; i++) {
-        printf("Calling Inode %d\n",i);
-        for(j = 0; j < 64; j++) {
-            GetInode(i);
-        }
-        printf("%d Calls to Inode %d Successful\n",j,i);
-        printf("Cache Hash Table: \n");
-        PrintInodeCacheHashSet(inode_stack);
-        printf("Cache Stack\n");
-        PrintInodeCacheStack(inode_stack);
+/**
+ * Returns a block the caller is about to overwrite completely. On a miss the
+ * block is installed without reading its sector, so its buffer holds
+ * garbage until the caller fills all of it in.
+ * @param block_num The number of the block being overwritten
+ * @param block_class Class of the block, see GetBlock
+ * @return The entry holding the block
+ */
+struct block_cache_entry* GetBlockForOverwrite(int block_num, int block_class) {
+    assert(block_num >= 1 && block_num <= block_count);
+    struct block_cache *stack = block_stacks[block_class];
+    struct block_cache *other = block_stacks[1 - block_class];
+    if (record_lookups) RecordBlockAccess(stack->mrc, block_num);
+
+    struct block_cache_entry *current = LookUpPinnedBlock(block_num);
+    if (current != NULL) return UseBlock(current, NULL);
+
+    current = LookUpBlock(stack, block_num);
+    if (current != NULL) {
+        stack->hits++;
+        return UseBlock(current, NULL);
     }
 
+    /** A copy from before the block was freed may still be cached */
+    current = LookUpBlock(other, block_num);
+    if (current != NULL) {
+        other->hits++;
+        return UseBlock(current, NULL);
+    }
+
+    /** The compressed copy would be stale once the caller overwrites the block */
+    if (victim_cache != NULL) DropVictim(victim_cache, block_num);
+    stack->installs++;
+    return AddToBlockCache(stack, block_num);
 }
 
-void TestBlockCache(int num_blocks) {
-    int i;
-    int block_number;
-    for(i = 1; i <= 64; i++) {
-        block_number = (rand() % num_blocks)+1;
-        printf("Call %d: Calling Block %d\n",i,block_number);
-        GetBlock(block_number);
-        printf("Cache Hash Table: \n");
-        PrintBlockCacheHashSet(block_stack);
-        printf("Cache Stack\n");
-        PrintBlockCacheStack(block_stack);
-        printf("Cache Size: %d\n",block_stack->stack_size);
-    }
-    int j;
-    for(i = 1; i <= num_blocks; i++) {
-        printf("Calling Block %d\n",i);
-        for(j = 0; j < 64; j++) {
-            GetBlock(i);
-        }
-        printf("%d Calls to Inode %d Successful\n",j,i);
-        printf("Cache Hash Table: \n");
-        PrintBlockCacheHashSet(block_stack);
-        printf("Cache Stack\n");
-        PrintBlockCacheStack(block_stack);
-    }
+/**
+ * Gives up on a block returned by GetBlockForOverwrite that the caller could
+ * not fill in. A clean entry may have been installed with garbage, so it is
+ * dropped and the next lookup reads the sector again. A dirty entry already
+ * held the block's contents and is kept.
+ * @param entry The entry GetBlockForOverwrite returned
+ */
+void AbandonOverwrite(struct block_cache_entry *entry) {
+    if (entry->dirty || entry->pin_count > 0 || entry->cache == pinned_blocks) return;
+    RemoveFromBlockCache(entry->cache, entry);
+}
+
+/**
+ * Returns a zero filled, dirty block for a block number that was just taken
+ * from the free list. Its old contents are garbage, so the sector is not read.
+ * @param block_num The number of the newly allocated block
+ * @param block_class Class the block will be used as, see GetBlock
+ * @return The entry holding the block
+ */
+struct block_cache_entry* GetNewBlock(int block_num, int block_class) {
+    struct block_cache_entry *current = GetBlockForOverwrite(block_num, block_class);
+    memset(current->block, 0, BLOCKSIZE);
+    MarkBlockDirty(current);
+    return current;
 }
+
+/**
+ * Prints out each list of the Block Cache as a stack
+ */
+ void PrintBlockCacheStack(struct block_cache* stack) {
+     struct block_cache_entry* position;
+     int list;
+     for (list = 0; list < BLOCK_LISTS; list++) {
+         printf("List %d (%s)\n", list, stack->policy->name);
+         for (position = stack->lists[list].top; position != NULL; position = position->next_lru) {
+             printf("| %d |\n", position->block_number);
+         }
+     }
+ }
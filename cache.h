@@ -2,21 +2,100 @@
 #define COMP421_LAB3_CACHE_H
 
 
+#define BLOCK_LISTS 2 //Number of resident and of ghost lists, see policy.h
+#define DIRTY_HIGH_PERCENT 50 //Dirty share of the block cache that starts a flush between requests
+#define DIRTY_LOW_PERCENT 25 //Dirty share of the block cache a flush stops at
+#define INODE_PER_BLOCK (BLOCKSIZE / INODESIZE)
+#define INODE_FILL_MAX (INODE_PER_BLOCK - 1) //Inodes one miss may add alongside the missed inode, the rest of its block
+
+/**
+ * Block classes. Each class has its own partition of the block cache, so
+ * streaming file data cannot push out inode, directory and indirect blocks.
+ */
+#define BLOCK_METADATA 0
+#define BLOCK_DATA 1
+#define BLOCK_CLASSES 2
+#define BLOCK_PINNED BLOCK_CLASSES //Not a class: the space reserved for pinned files, see PinCachedBlock
+
+extern int disk_reads; //Sectors read by the server
+extern int disk_writes; //Sectors written by the server
+extern int record_lookups; //Whether block lookups go into the miss ratio curves, 0 outside request handlers
+extern struct block_cache* pinned_blocks; //Reserved partition for pinned files, NULL if none
+
+struct block_list {
+    struct block_cache_entry* top; //Most recently used end of the list
+    struct block_cache_entry* base; //Least recently used end of the list
+    int size; //Number of entries on the list
+};
+
+struct ghost_entry {
+    int block_number; //Number of a block that was evicted
+    int list; //Ghost list this entry is on
+    struct ghost_entry* prev_lru; //Newer ghost in the list
+    struct ghost_entry* next_lru; //Older ghost in the list, or next free ghost
+    struct ghost_entry* prev_hash;
+    struct ghost_entry* next_hash;
+};
+
+struct ghost_list {
+    struct ghost_entry* top; //Most recently evicted
+    struct ghost_entry* base; //Least recently evicted
+    int size; //Number of ghosts on the list
+};
+
 struct block_cache {
-    struct block_cache_entry* top; //Top of the cache stack
-    struct block_cache_entry* base; //Bottom of the cache stack
+    struct block_list lists[BLOCK_LISTS]; //Resident entries, ordered by the replacement policy
     struct block_cache_entry** hash_set;
-    int stack_size; //Number of entries in the cache stack
-    int hash_size;
+    int stack_size; //Number of entries in the cache
+    int capacity; //Maximum number of entries, set when the server starts
+    int hash_size; //Number of buckets in hash_set, always a power of two
+    struct block_cache_entry* entries; //Preallocated entries, one per cache slot
+    void* arena; //Allocation backing buffers
+    char* buffers; //capacity sector aligned block buffers inside arena
+    struct replacement_policy* policy; //Chooses which entry to evict
+    struct ghost_list ghosts[BLOCK_LISTS]; //Numbers of recently evicted blocks
+    struct ghost_entry** ghost_hash_set; //Ghosts hashed like hash_set
+    struct ghost_entry* ghost_pool; //Preallocated ghosts, one per cache slot
+    struct ghost_entry* ghost_free; //Unused ghosts, linked by next_lru
+    int target_recent; //ARC's target size for the recent list
+    int ghost_hit_frequent; //ARC: the block being added was a frequent ghost
+    int evict_without_ghost; //ARC: the next victim is not remembered
+    int dirty_count; //Number of dirty entries
+    int dirty_high; //FlushDirtyBlocks starts writing above this many dirty entries
+    int dirty_low; //FlushDirtyBlocks stops writing at this many dirty entries
+    struct block_cache_entry* dirty_list; //Dirty entries, most recently dirtied first
+    struct block_cache_entry** sync_order; //Scratch array SyncDirtyBlocks sorts dirty entries in
+    int last_sync_sectors; //Sectors written by the last SyncDirtyBlocks
+    int last_sync_runs; //Runs of consecutive sectors written by the last SyncDirtyBlocks
+    int total_sync_sectors; //Sectors written by every SyncDirtyBlocks so far
+    int total_sync_runs; //Runs of consecutive sectors written by every SyncDirtyBlocks so far
+    int hits; //GetBlock calls that found a block in this partition
+    int misses; //GetBlock calls that read a block into this partition
+    int installs; //Blocks added to this partition without reading their sector
+    int evictions; //Entries recycled for another block
+    int writebacks; //Dirty entries written to disk
+    int prefetches; //Blocks PrefetchBlock read into this partition
+    int prefetch_hits; //Prefetched blocks a lookup then found
+    int prefetch_wasted; //Prefetched blocks evicted before any lookup found them
+    struct miss_ratio_curve* mrc; //Hit rates this partition would have at other sizes
+    struct block_cache_entry* free_entries; //Entries RemoveFromBlockCache freed, linked by next_lru
 };
 
 struct block_cache_entry {
     void* block;
+    struct block_cache* cache; //Partition the entry belongs to
     int block_number; //Item that this entry represents. Can either be a block or inode
+    int list; //Resident list the entry is on
     struct block_cache_entry* prev_lru; //Previous Block in Stack
     struct block_cache_entry* next_lru; //Next Block in Stack
     struct block_cache_entry* prev_hash;
     struct block_cache_entry* next_hash;
+    struct block_cache_entry* prev_dirty; //Neighbors in the dirty list, only valid while dirty
+    struct block_cache_entry* next_dirty;
+    int pin_count; //Number of PinBlock calls not yet undone, pinned entries are never evicted
+    int block_class; //In the reserved partition, the class the block returns to when unpinned
+    int file_pins; //In the reserved partition, pinned files the block belongs to
+    int prefetched; //Read by PrefetchBlock and not looked up since
     int dirty; //Whether or not this
 };
 
@@ -25,35 +104,61 @@ struct inode_cache {
     struct inode_cache_entry* base; //Bottom of the cache stack
     struct inode_cache_entry** hash_set;
     int stack_size; //Number of entries in the cache stack
-    int hash_size; //Number of hash collisions
+    int capacity; //Maximum number of entries, set when the server starts
+    int hash_size; //Number of buckets in hash_set, always a power of two
+    struct inode_cache_entry* dirty_list; //Dirty entries, most recently dirtied first
+    int hits; //GetInode calls that found the inode cached
+    int misses; //GetInode calls that read the inode from its block
+    int evictions; //Entries recycled for another inode
+    int writebacks; //Dirty inodes copied back into their blocks
+    int fills; //Inodes cached because an inode in the same block missed
+    struct inode_cache_entry* entries; //Preallocated entries, one per cache slot
+    struct inode* copies; //Preallocated inode copies owned by the entries
 };
 
 struct inode_cache_entry {
-    struct inode* inode; //Item that this entry represents. Can either be a block or inode
+    struct inode* inode; //Copy of the inode owned by this entry, one of copies
     int inum; //Inode/Block number of the cache entry.
     struct inode_cache_entry* prev_lru; //Previous Inode in Stack
     struct inode_cache_entry* next_lru; //Next Inode in Stack
     struct inode_cache_entry* prev_hash;
     struct inode_cache_entry* next_hash;
+    struct inode_cache_entry* prev_dirty; //Neighbors in the dirty list, only valid while dirty
+    struct inode_cache_entry* next_dirty;
     int dirty; //Whether or not this
+    int pin_count; //Number of PinInode calls not yet undone, pinned entries are never evicted
 };
 
+int ReadDiskSector(int sector_num, void* buf);
+
+int WriteDiskSector(int sector_num, void* buf);
+
 /*********************
  * Inode Cache Code *
  ********************/
 
-struct inode_cache *CreateInodeCache();
+struct inode_cache *CreateInodeCache(int num_inodes, int capacity);
 
-void AddToInodeCache(struct inode_cache *stack, struct inode *in, int inumber);
+struct inode_cache_entry* AddToInodeCache(struct inode_cache *stack, struct inode *in, int inumber);
+
+int AddToInodeCacheBase(struct inode_cache *stack, struct inode *inode, int inum, int skip);
 
 struct inode_cache_entry* LookUpInode(struct inode_cache *stack, int inumber);
 
 void RaiseInodeCachePosition(struct inode_cache* stack, struct inode_cache_entry* recent_access);
 
+void PinInode(struct inode_cache_entry* entry);
+
+void UnpinInode(struct inode_cache_entry* entry);
+
+void MarkInodeDirty(struct inode_cache_entry* entry);
+
 void WriteBackInode(struct inode_cache_entry* out);
 
 struct inode_cache_entry* GetInode(int inode_num);
 
+struct inode* PeekCachedInode(int inum);
+
 void PrintInodeCacheHashSet(struct inode_cache* stack);
 
 void PrintInodeCacheStack(struct inode_cache* stack);
@@ -62,26 +167,56 @@ void PrintInodeCacheStack(struct inode_cache* stack);
  * Block Cache Code *
  ********************/
 
-struct block_cache *CreateBlockCache(int num_blocks);
+struct block_cache *CreateBlockCache(int num_blocks, int capacity, struct replacement_policy* policy, int block_class);
 
-void AddToBlockCache(struct block_cache *stack, void* block, int block_number);
+struct block_cache_entry* AddToBlockCache(struct block_cache *stack, int block_number);
 
 struct block_cache_entry* LookUpBlock(struct block_cache *stack, int block_number);
 
 void RaiseBlockCachePosition(struct block_cache *stack, struct block_cache_entry* recent_access);
 
+void DemoteBlock(struct block_cache_entry* entry);
+
+void DemoteCachedBlock(int block_num);
+
+void DropCachedBlock(int block_num);
+
+void* PeekCachedBlock(int block_num);
+
+void RemoveFromBlockCache(struct block_cache *stack, struct block_cache_entry *entry);
+
+void PinBlock(struct block_cache_entry* entry);
+
+void UnpinBlock(struct block_cache_entry* entry);
+
+void MarkBlockDirty(struct block_cache_entry* entry);
+
 void WriteBackBlock(struct block_cache_entry* out);
 
-struct block_cache_entry* GetBlock(int block_num);
+void FlushDirtyBlocks(struct block_cache* stack);
 
-void PrintBlockCacheHashSet(struct block_cache* stack);
+int CleanDirtyBlocks(struct block_cache* stack, int max);
 
-void PrintBlockCacheStack(struct block_cache* stack);
+void SyncDirtyBlocks(struct block_cache* stack);
+
+struct block_cache_entry* GetBlock(int block_num, int block_class);
 
-int HashIndex(int key_value);
+struct block_cache_entry* GetBlockOnce(int block_num, int block_class);
 
-void TestInodeCache(int num_inodes);
+struct block_cache_entry* GetBlockForOverwrite(int block_num, int block_class);
 
-void TestBlockCache(int num_blocks);
+void AbandonOverwrite(struct block_cache_entry *entry);
+
+struct block_cache_entry* GetNewBlock(int block_num, int block_class);
+
+int PrefetchBlock(int block_num, int block_class);
+
+struct block_cache_entry* PinCachedBlock(int block_num, int block_class);
+
+void UnpinCachedBlock(struct block_cache_entry* entry);
+
+void PrintBlockCacheHashSet(struct block_cache* stack);
+
+void PrintBlockCacheStack(struct block_cache* stack);
 
 #endif //COMP421_LAB3_CACHE_H
@@ -0,0 +1,340 @@
+/*
+ *  Host-side tests and benchmark for the block and inode caches.
+ *
+ *  This is a Unix program (not a Yalnix program).  It links the real
+ *  cache.c, policy.c, mrc.c and victim.c against an in-memory disk that
+ *  stands in for ReadSector and WriteSector, and builds on plain Linux
+ *  with the headers in host/ (see the cachebench rule in the Makefile).
+ *
+ *  It first checks the caches against a shadow copy of the disk: random
+ *  reads, writes, overwrites, new blocks, flushes and pins are made through
+ *  the block cache under every policy, with and without the victim tier,
+ *  and random inode updates through the inode cache.  Every block or inode
+ *  handed out must hold what was last written to it, and after a sync the
+ *  disk must match the shadow.  A pinned inode must also stay cached while
+ *  misses on other inode blocks fill in their neighbours.  Any mismatch
+ *  stops the program with exit status 1.
+ *
+ *  It then replays synthetic traces against each policy and reports the
+ *  time per lookup, the hit rate, and the sectors read and written back:
+ *    seq       passes over a file twice the size of the cache
+ *    zipf      blocks drawn from a zipfian distribution (theta 0.99)
+ *    scan+hot  a small hot set touched between the blocks of a long scan
+ *  A fifth of the lookups dirty their block, and the dirty watermark flush
+ *  runs every few lookups the way the server runs it between requests.
+ *
+ *  Usage: cachebench [capacity] [lookups] [victim_bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <comp421/filesystem.h>
+#include "cache.h"
+#include "policy.h"
+#include "victim.h"
+
+#define DEFAULT_CAPACITY    128
+#define DEFAULT_LOOKUPS     1000000
+#define WRITE_PERCENT       20   /* Lookups that dirty their block */
+#define FLUSH_INTERVAL      8    /* Lookups between two FlushDirtyBlocks calls */
+#define ZIPF_THETA          0.99
+#define ZIPF_SPAN           8    /* Zipf blocks drawn from capacity * ZIPF_SPAN */
+#define HOT_PERCENT         50   /* Scan+hot lookups that go to the hot set */
+
+#define CHECK_BLOCKS        200  /* Blocks the block check touches */
+#define CHECK_OPS           50000
+#define CHECK_PINS          8    /* Size of the reserved partition in the block check */
+#define CHECK_INODES        255  /* Inodes in the file system the inode check formats */
+#define CHECK_INODE_OPS     20000
+#define CHECK_INODE_PINS    4    /* Size of the inode cache a pinned entry must survive in */
+
+extern struct block_cache* block_stacks[BLOCK_CLASSES];
+extern struct inode_cache* inode_stack;
+
+char disk[NUMSECTORS][SECTORSIZE];
+long sector_reads;
+long sector_writes;
+
+int ReadSector(int sectornum, void *buf) {
+    memcpy(buf, disk[sectornum], SECTORSIZE);
+    sector_reads++;
+    return 0;
+}
+
+int WriteSector(int sectornum, void *buf) {
+    memcpy(disk[sectornum], buf, SECTORSIZE);
+    sector_writes++;
+    return 0;
+}
+
+/**
+ * Small deterministic generator, so traces and checks are the same on every
+ * host and every run
+ */
+unsigned long rng_state;
+
+unsigned long NextRandom(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+void Fail(char *check, char *what, int number) {
+    printf("check %s: FAILED, %s %d\n", check, what, number);
+    exit(1);
+}
+
+/**
+ * Starts every run from an empty cache and a disk of random bytes. Caches of
+ * earlier runs are abandoned, the program is short lived.
+ */
+void ResetCaches(char *policy, int metadata_capacity, int data_capacity, int pinned_capacity, int victim_bytes) {
+    unsigned int i;
+    for (i = 0; i < sizeof(disk); i++) ((char *)disk)[i] = NextRandom();
+    pinned_blocks = NULL;
+    victim_cache = NULL;
+    CreateBlockCache(NUMBLOCKS, metadata_capacity, GetReplacementPolicy(policy), BLOCK_METADATA);
+    CreateBlockCache(NUMBLOCKS, data_capacity, GetReplacementPolicy(policy), BLOCK_DATA);
+    if (pinned_capacity > 0) CreateBlockCache(NUMBLOCKS, pinned_capacity, GetReplacementPolicy(policy), BLOCK_PINNED);
+    if (victim_bytes > 0) CreateVictimCache(victim_bytes);
+    sector_reads = 0;
+    sector_writes = 0;
+}
+
+/**
+ * Random block operations checked against a shadow copy of every block
+ */
+void CheckBlockCache(char *policy, int victim_bytes) {
+    static char shadow[CHECK_BLOCKS + 1][BLOCKSIZE];
+    struct block_cache_entry *pinned[CHECK_PINS];
+    struct block_cache_entry *entry;
+    char name[32];
+    int num_pinned = 0;
+    int block_num;
+    int block_class;
+    int op;
+    int i;
+
+    sprintf(name, "%s%s", policy, victim_bytes > 0 ? "+victim" : "");
+    ResetCaches(policy, 8, 16, CHECK_PINS, victim_bytes);
+    for (i = 1; i <= CHECK_BLOCKS; i++) memcpy(shadow[i], disk[i], BLOCKSIZE);
+
+    for (i = 0; i < CHECK_OPS; i++) {
+        block_num = NextRandom() % CHECK_BLOCKS + 1;
+        block_class = NextRandom() % BLOCK_CLASSES;
+        op = NextRandom() % 100;
+        if (op < 55) {
+            entry = GetBlock(block_num, block_class);
+            if (memcmp(entry->block, shadow[block_num], BLOCKSIZE) != 0) Fail(name, "stale read of block", block_num);
+        } else if (op < 75) {
+            entry = GetBlock(block_num, block_class);
+            ((char *)entry->block)[i % BLOCKSIZE] = i;
+            shadow[block_num][i % BLOCKSIZE] = i;
+            MarkBlockDirty(entry);
+        } else if (op < 83) {
+            entry = GetNewBlock(block_num, block_class);
+            memset(shadow[block_num], 0, BLOCKSIZE);
+        } else if (op < 90) {
+            entry = GetBlockForOverwrite(block_num, block_class);
+            memset(entry->block, i, BLOCKSIZE);
+            memset(shadow[block_num], i, BLOCKSIZE);
+            MarkBlockDirty(entry);
+        } else if (op < 95) {
+            FlushDirtyBlocks(block_stacks[block_class]);
+        } else if (op < 98 && num_pinned < CHECK_PINS) {
+            entry = PinCachedBlock(block_num, block_class);
+            if (entry->file_pins == 0) pinned[num_pinned++] = entry;
+            entry->file_pins++;
+        } else if (num_pinned > 0) {
+            op = NextRandom() % num_pinned;
+            UnpinCachedBlock(pinned[op]);
+            pinned[op] = pinned[--num_pinned];
+        }
+    }
+
+    for (i = 0; i < BLOCK_CLASSES; i++) SyncDirtyBlocks(block_stacks[i]);
+    SyncDirtyBlocks(pinned_blocks);
+    for (i = 1; i <= CHECK_BLOCKS; i++)
+        if (memcmp(disk[i], shadow[i], BLOCKSIZE) != 0) Fail(name, "block not synced", i);
+    printf("check %s: ok, %d operations, %ld sectors read, %ld written\n", name, CHECK_OPS, sector_reads, sector_writes);
+}
+
+/**
+ * Random inode updates through a small inode cache, checked against a
+ * shadow copy of every inode
+ */
+void CheckInodeCache(void) {
+    static struct inode shadow[CHECK_INODES + 1];
+    struct inode_cache_entry *entry;
+    struct inode_cache_entry *held;
+    struct inode *on_disk;
+    int inode_blocks = (CHECK_INODES + 1) / INODE_PER_BLOCK;
+    int inum;
+    int i;
+
+    ResetCaches("lru", 8, 16, 0, 0);
+    CreateInodeCache(CHECK_INODES, INODE_CACHESIZE);
+    memset(disk[1], 0, inode_blocks * BLOCKSIZE);
+    ((struct fs_header *)disk[1])->num_blocks = NUMBLOCKS;
+    ((struct fs_header *)disk[1])->num_inodes = CHECK_INODES;
+    for (inum = 1; inum <= CHECK_INODES; inum++) {
+        on_disk = (struct inode *)disk[inum / INODE_PER_BLOCK + 1] + inum % INODE_PER_BLOCK;
+        on_disk->type = inum % 3 == 0 ? INODE_FREE : INODE_REGULAR;
+        on_disk->size = inum;
+        shadow[inum] = *on_disk;
+    }
+
+    for (i = 0; i < CHECK_INODE_OPS; i++) {
+        /** Favour low numbers so some blocks are hot and neighbours get filled */
+        inum = NextRandom() % (NextRandom() % 2 ? 32 : CHECK_INODES) + 1;
+        entry = GetInode(inum);
+        if (memcmp(entry->inode, &shadow[inum], sizeof(struct inode)) != 0) Fail("inode", "stale inode", inum);
+        if (NextRandom() % 4 == 0) {
+            entry->inode->size = i;
+            shadow[inum].size = i;
+            MarkInodeDirty(entry);
+        }
+    }
+
+    while (inode_stack->dirty_list != NULL) WriteBackInode(inode_stack->dirty_list);
+    for (i = 0; i < BLOCK_CLASSES; i++) SyncDirtyBlocks(block_stacks[i]);
+    for (inum = 1; inum <= CHECK_INODES; inum++) {
+        on_disk = (struct inode *)disk[inum / INODE_PER_BLOCK + 1] + inum % INODE_PER_BLOCK;
+        if (memcmp(on_disk, &shadow[inum], sizeof(struct inode)) != 0) Fail("inode", "inode not synced", inum);
+    }
+    printf("check inode: ok, %d lookups, %d hits, %d filled, %ld sectors read, %ld written\n",
+           CHECK_INODE_OPS, inode_stack->hits, inode_stack->fills, sector_reads, sector_writes);
+
+    /** A handler holding a pinned entry across misses that fill in neighbours */
+    CreateInodeCache(CHECK_INODES, CHECK_INODE_PINS);
+    held = GetInode(1);
+    PinInode(held);
+    for (inum = INODE_PER_BLOCK; inum <= CHECK_INODES; inum += INODE_PER_BLOCK) GetInode(inum);
+    if (held->inum != 1 || memcmp(held->inode, &shadow[1], sizeof(struct inode)) != 0) Fail("inode", "pinned inode recycled", 1);
+    UnpinInode(held);
+    printf("check inode pin: ok, held across %d misses\n", inode_stack->misses - 1);
+}
+
+void SequentialTrace(int *trace, int lookups, int capacity) {
+    int i;
+    for (i = 0; i < lookups; i++) trace[i] = i % (2 * capacity) + 1;
+}
+
+/**
+ * Draws blocks by rank from a zipfian distribution, block 1 the most popular
+ */
+void ZipfTrace(int *trace, int lookups, int capacity) {
+    int span = capacity * ZIPF_SPAN;
+    double *cdf = malloc(span * sizeof(double));
+    double sum = 0;
+    double u;
+    int low, high, mid;
+    int i;
+
+    for (i = 0; i < span; i++) {
+        sum += 1.0 / pow(i + 1, ZIPF_THETA);
+        cdf[i] = sum;
+    }
+    for (i = 0; i < lookups; i++) {
+        u = (double)(NextRandom() % 1000000000) / 1000000000 * sum;
+        low = 0;
+        high = span - 1;
+        while (low < high) {
+            mid = (low + high) / 2;
+            if (cdf[mid] < u) low = mid + 1;
+            else high = mid;
+        }
+        trace[i] = low + 1;
+    }
+    free(cdf);
+}
+
+/**
+ * Touches a hot set of a quarter of the cache between the blocks of a scan
+ * over the rest of the disk
+ */
+void ScanHotTrace(int *trace, int lookups, int capacity) {
+    int hot = capacity / 4;
+    int scan = 0;
+    int i;
+    for (i = 0; i < lookups; i++) {
+        if ((int)(NextRandom() % 100) < HOT_PERCENT) {
+            trace[i] = NextRandom() % hot + 1;
+        } else {
+            trace[i] = hot + 1 + scan;
+            scan = (scan + 1) % (NUMBLOCKS - hot - 1);
+        }
+    }
+}
+
+/**
+ * Replays a trace against fresh caches, every block in the data partition
+ */
+void RunTrace(char *trace_name, int *trace, char *writes, int lookups, char *policy, int capacity, int victim_bytes) {
+    struct block_cache *stack;
+    struct block_cache_entry *entry;
+    struct timespec start, end;
+    double ns;
+    int i;
+
+    ResetCaches(policy, 4, capacity, 0, victim_bytes);
+    stack = block_stacks[BLOCK_DATA];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++) {
+        entry = GetBlock(trace[i], BLOCK_DATA);
+        if (writes[i]) {
+            ((char *)entry->block)[0]++;
+            MarkBlockDirty(entry);
+        }
+        if (i % FLUSH_INTERVAL == 0) FlushDirtyBlocks(stack);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("%-9s %-6s %10.1f %9.1f%% %12ld %12d\n", trace_name, policy, ns / lookups,
+           100.0 * stack->hits / lookups, sector_reads, stack->writebacks);
+}
+
+int main(int argc, char **argv) {
+    int capacity = DEFAULT_CAPACITY;
+    int lookups = DEFAULT_LOOKUPS;
+    int victim_bytes = 0;
+    char *policies[] = {"lru", "2q", "arc"};
+    char *trace_names[] = {"seq", "zipf", "scan+hot"};
+    void (*generators[])(int *, int, int) = {SequentialTrace, ZipfTrace, ScanHotTrace};
+    int *trace;
+    char *writes;
+    int t;
+    int i;
+
+    if ((argc > 1 && sscanf(argv[1], "%d", &capacity) != 1) ||
+        (argc > 2 && sscanf(argv[2], "%d", &lookups) != 1) ||
+        (argc > 3 && sscanf(argv[3], "%d", &victim_bytes) != 1) ||
+        capacity < 16 || capacity * ZIPF_SPAN >= NUMBLOCKS || lookups < 1 || victim_bytes < 0) {
+        fprintf(stderr, "usage: cachebench [capacity] [lookups] [victim_bytes]\n");
+        fprintf(stderr, "       capacity from 16 to %d\n", (NUMBLOCKS - 1) / ZIPF_SPAN);
+        exit(1);
+    }
+
+    rng_state = 88172645463325252UL;
+    for (i = 0; i < 3; i++) {
+        CheckBlockCache(policies[i], 0);
+        CheckBlockCache(policies[i], 4 * BLOCKSIZE);
+    }
+    CheckInodeCache();
+
+    trace = malloc(lookups * sizeof(int));
+    writes = malloc(lookups);
+    printf("\ncapacity %d, %d lookups, %d%% writes, victim tier %d bytes\n", capacity, lookups, WRITE_PERCENT, victim_bytes);
+    printf("%-9s %-6s %10s %10s %12s %12s\n", "trace", "policy", "ns/lookup", "hit rate", "disk reads", "writebacks");
+    for (t = 0; t < 3; t++) {
+        generators[t](trace, lookups, capacity);
+        for (i = 0; i < lookups; i++) writes[i] = (int)(NextRandom() % 100) < WRITE_PERCENT;
+        for (i = 0; i < 3; i++) RunTrace(trace_names[t], trace, writes, lookups, policies[i], capacity, victim_bytes);
+    }
+    exit(0);
+}
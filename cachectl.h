@@ -0,0 +1,41 @@
+#ifndef COMP421_LAB3_CACHECTL_H
+#define COMP421_LAB3_CACHECTL_H
+
+/*
+ * Cache control calls a client can make to the file server, beyond the
+ * ones comp421/iolib.h declares.
+ */
+
+/*
+ * Advice for Advise. NORMAL, SEQUENTIAL and RANDOM describe how the whole
+ * file will be read from now on and replace the file's earlier advice.
+ * WILLNEED and DONTNEED are about the given range only.
+ */
+#define ADVISE_NORMAL       0 /* No particular pattern */
+#define ADVISE_SEQUENTIAL   1 /* Read once front to back: keep blocks read out of the way of others */
+#define ADVISE_RANDOM       2 /* Read in no order: do not read ahead */
+#define ADVISE_WILLNEED     3 /* Fetch the range into the cache soon */
+#define ADVISE_DONTNEED     4 /* Let the range's cached blocks be evicted first */
+
+/*
+ * Tell the server how the file open as fd will be accessed, for len bytes
+ * from offset (len 0 means up to the end of the file). The server keeps the
+ * advice per file, so it applies to every descriptor open on the file.
+ * Return 0, or -1 if fd is not open or the arguments are invalid.
+ */
+int Advise(int fd, int offset, int len, int advice);
+
+/*
+ * Pin the blocks pathname has now (its inode block, data blocks and
+ * indirect block) in the space the server reserved with -r, so reading
+ * them never goes to the disk. Return 0, or -1 if the file does not exist
+ * or does not fit in what is left of the reserved space.
+ */
+int PinFile(char *pathname);
+
+/*
+ * Release the blocks PinFile pinned. Return 0, or -1 if the file is not pinned.
+ */
+int UnpinFile(char *pathname);
+
+#endif //COMP421_LAB3_CACHECTL_H
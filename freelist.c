@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+#include <comp421/filesystem.h>
+#include "freelist.h"
+
+#define BLOCK_POINTERS (int)(BLOCKSIZE / sizeof(int)) //Block numbers an indirect block holds
+
+void SetBitmapBit(unsigned char *bitmap, int n, int used) {
+    if (used) bitmap[n / 8] |= 1 << (n % 8);
+    else bitmap[n / 8] &= ~(1 << (n % 8));
+}
+
+int GetBitmapBit(unsigned char *bitmap, int n) {
+    return (bitmap[n / 8] >> (n % 8)) & 1;
+}
+
+/**
+ * Private helper that marks one block, ignoring holes and corrupt numbers
+ */
+void MarkBlock(unsigned char *used, int num_blocks, int block_num) {
+    if (block_num <= 0 || block_num >= num_blocks) return;
+    SetBitmapBit(used, block_num, 1);
+}
+
+void MarkBlockRange(unsigned char *used, int num_blocks, int first, int count) {
+    int i;
+    for (i = first; i < first + count; i++) MarkBlock(used, num_blocks, i);
+}
+
+void MarkFileBlocks(unsigned char *used, int num_blocks, struct inode *inode, int *indirect_block) {
+    int block_count = (inode->size + BLOCKSIZE - 1) / BLOCKSIZE;
+    int i;
+
+    for (i = 0; i < block_count && i < NUM_DIRECT; i++) MarkBlock(used, num_blocks, inode->direct[i]);
+    if (block_count <= NUM_DIRECT) return;
+
+    MarkBlock(used, num_blocks, inode->indirect);
+    if (indirect_block == NULL) return;
+    for (i = 0; i < block_count - NUM_DIRECT && i < BLOCK_POINTERS; i++)
+        MarkBlock(used, num_blocks, indirect_block[i]);
+}
+
+struct extent_list *CreateExtentList(int num_blocks) {
+    struct extent_list *list = malloc(sizeof(struct extent_list));
+    list->capacity = num_blocks / 2 + 1;
+    list->extents = malloc(list->capacity * sizeof(struct extent));
+    list->count = 0;
+    list->free_blocks = 0;
+    return list;
+}
+
+struct extent_list *SweepFreeExtents(unsigned char *used, int num_blocks) {
+    struct extent_list *list = CreateExtentList(num_blocks);
+    struct extent *last = NULL;
+    int i;
+
+    /* Block 0 is the boot block and not used by the file system */
+    for (i = 1; i < num_blocks; i++) {
+        if (GetBitmapBit(used, i)) continue;
+        if (last != NULL && last->start + last->length == i) {
+            last->length++;
+        } else {
+            last = &list->extents[list->count++];
+            last->start = i;
+            last->length = 1;
+        }
+        list->free_blocks++;
+    }
+    return list;
+}
+
+/**
+ * Private helper that finds the last extent starting at or before block_num
+ * @return Its index, -1 if every extent starts after block_num
+ */
+int FindExtent(struct extent_list *list, int block_num) {
+    int low = 0;
+    int high = list->count - 1;
+    int mid;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (list->extents[mid].start <= block_num) low = mid + 1;
+        else high = mid - 1;
+    }
+    return high;
+}
+
+/**
+ * Private helper that removes one block from extent index, splitting it in
+ * two if the block is in the middle
+ */
+void TakeExtentBlock(struct extent_list *list, int index, int block_num) {
+    struct extent *extent = &list->extents[index];
+    int end = extent->start + extent->length;
+
+    if (block_num == extent->start) {
+        extent->start++;
+        extent->length--;
+        if (extent->length == 0) {
+            list->count--;
+            memmove(extent, extent + 1, (list->count - index) * sizeof(struct extent));
+        }
+    } else if (block_num == end - 1) {
+        extent->length--;
+    } else {
+        memmove(extent + 2, extent + 1, (list->count - index - 1) * sizeof(struct extent));
+        list->count++;
+        extent->length = block_num - extent->start;
+        extent[1].start = block_num + 1;
+        extent[1].length = end - block_num - 1;
+    }
+    list->free_blocks--;
+}
+
+int AllocExtentBlock(struct extent_list *list, int prev_block, int run) {
+    struct extent *extent;
+    int best = -1;
+    int largest = -1;
+    int i;
+
+    if (list->count == 0) return 0;
+
+    /* Keep the file contiguous when the next block is free */
+    if (prev_block > 0) {
+        i = FindExtent(list, prev_block + 1);
+        if (i >= 0 && prev_block + 1 < list->extents[i].start + list->extents[i].length) {
+            TakeExtentBlock(list, i, prev_block + 1);
+            return prev_block + 1;
+        }
+    }
+
+    /* Best fit, so small files fill small gaps and large runs stay whole */
+    for (i = 0; i < list->count; i++) {
+        extent = &list->extents[i];
+        if (extent->length >= run && (best < 0 || extent->length < list->extents[best].length)) best = i;
+        if (largest < 0 || extent->length > list->extents[largest].length) largest = i;
+    }
+    if (best < 0) best = largest;
+
+    i = list->extents[best].start;
+    TakeExtentBlock(list, best, i);
+    return i;
+}
+
+void FreeExtentBlock(struct extent_list *list, int block_num) {
+    int i = FindExtent(list, block_num);
+    struct extent *left = i >= 0 ? &list->extents[i] : NULL;
+    struct extent *right = i + 1 < list->count ? &list->extents[i + 1] : NULL;
+    int joins_left = left != NULL && left->start + left->length == block_num;
+    int joins_right = right != NULL && right->start == block_num + 1;
+
+    /* Already free */
+    if (left != NULL && block_num < left->start + left->length) return;
+
+    if (joins_left && joins_right) {
+        left->length += 1 + right->length;
+        list->count--;
+        memmove(right, right + 1, (list->count - i - 1) * sizeof(struct extent));
+    } else if (joins_left) {
+        left->length++;
+    } else if (joins_right) {
+        right->start--;
+        right->length++;
+    } else {
+        memmove(&list->extents[i + 2], &list->extents[i + 1], (list->count - i - 1) * sizeof(struct extent));
+        list->count++;
+        list->extents[i + 1].start = block_num;
+        list->extents[i + 1].length = 1;
+    }
+    list->free_blocks++;
+}
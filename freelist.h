@@ -0,0 +1,85 @@
+#ifndef COMP421_LAB3_FREELIST_H
+#define COMP421_LAB3_FREELIST_H
+
+/**
+ * A run of free blocks
+ */
+struct extent {
+    int start; //First block of the run
+    int length; //Number of blocks in the run
+};
+
+/**
+ * The free blocks of a disk as runs, so a file can be given the block after
+ * its last one
+ */
+struct extent_list {
+    struct extent* extents; //Sorted by start, never touching each other
+    int count; //Number of extents
+    int capacity; //Room in extents, enough for every other block free
+    int free_blocks; //Blocks in all the extents
+};
+
+/**
+ * Sets or clears the bit of n in a bitmap of one bit per block or inode
+ * @param bitmap Bitmap to change
+ * @param n Block or inode number
+ * @param used 1 to set the bit, 0 to clear it
+ */
+void SetBitmapBit(unsigned char *bitmap, int n, int used);
+
+/**
+ * @return The bit of n in bitmap
+ */
+int GetBitmapBit(unsigned char *bitmap, int n);
+
+/**
+ * Marks count blocks starting at first as used
+ * @param used Bitmap of the blocks found in use so far
+ * @param num_blocks Number of blocks on the disk, numbers past it are ignored
+ */
+void MarkBlockRange(unsigned char *used, int num_blocks, int first, int count);
+
+/**
+ * Marks every block a file holds as used: its direct blocks, its indirect
+ * block and the blocks listed in it, as far as the file's size reaches.
+ * Holes and numbers outside the disk are skipped.
+ * @param used Bitmap of the blocks found in use so far
+ * @param num_blocks Number of blocks on the disk
+ * @param inode Inode of the file
+ * @param indirect_block Contents of the file's indirect block, NULL if it has none
+ */
+void MarkFileBlocks(unsigned char *used, int num_blocks, struct inode *inode, int *indirect_block);
+
+/**
+ * Creates an empty extent list for a disk
+ * @param num_blocks Number of blocks on the disk
+ */
+struct extent_list *CreateExtentList(int num_blocks);
+
+/**
+ * Builds the free extents from a bitmap of the blocks in use, in one pass
+ * over the disk
+ * @param used Bitmap of the blocks in use, filled by the Mark functions
+ * @param num_blocks Number of blocks on the disk
+ * @return List holding every unused block except the boot block
+ */
+struct extent_list *SweepFreeExtents(unsigned char *used, int num_blocks);
+
+/**
+ * Takes a free block, the one right after prev_block if that is free.
+ * Otherwise the first block of the smallest extent that holds run blocks,
+ * or of the largest extent if none does.
+ * @param list Free extents to take from
+ * @param prev_block Block the new one should follow, 0 if none
+ * @param run Number of blocks the caller is about to take in a row
+ * @return The block, 0 if the list is empty
+ */
+int AllocExtentBlock(struct extent_list *list, int prev_block, int run);
+
+/**
+ * Gives a block back, merging it with the extents on either side
+ */
+void FreeExtentBlock(struct extent_list *list, int block_num);
+
+#endif //COMP421_LAB3_FREELIST_H
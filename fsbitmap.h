@@ -0,0 +1,29 @@
+#ifndef COMP421_LAB3_FSBITMAP_H
+#define COMP421_LAB3_FSBITMAP_H
+
+/*
+ * Free block and free inode bitmaps kept on disk, so the server can mount
+ * without walking every inode. mkyfs places them right after the inode
+ * blocks and records them in the padding of the file system header. A set
+ * bit means the block or inode is in use. Disks made by the original mkyfs
+ * have no bitmaps and are mounted by scanning the inodes.
+ */
+
+#define FS_BITMAP_MAGIC     0x424d4150 /* bitmap_magic of a disk that has bitmaps */
+#define BITS_PER_BLOCK      (BLOCKSIZE * 8)
+#define BITMAP_BLOCKS(n)    (((n) + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK) /* Blocks holding n bits */
+
+/*
+ * The file system header as laid out by mkyfs, same size as struct fs_header
+ */
+struct fs_bitmap_header {
+    int num_blocks;     /* total blocks in file system */
+    int num_inodes;     /* number of inodes in file system */
+    int bitmap_magic;   /* FS_BITMAP_MAGIC if the fields below are valid */
+    int block_bitmap;   /* First block of the block bitmap, one bit per block number */
+    int inode_bitmap;   /* First block of the inode bitmap, one bit per inode number */
+    int clean;          /* 1 if the bitmaps were last written by a clean shutdown */
+    int padding[10];
+};
+
+#endif //COMP421_LAB3_FSBITMAP_H
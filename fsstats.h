@@ -0,0 +1,98 @@
+#ifndef COMP421_LAB3_FSSTATS_H
+#define COMP421_LAB3_FSSTATS_H
+
+/*
+ * Server statistics returned by GetFsStats. The server copies the whole
+ * struct to the caller, so both sides must be built from this header.
+ */
+
+#define FS_STATS_METADATA_BLOCKS 0 /* Metadata partition of the block cache */
+#define FS_STATS_DATA_BLOCKS 1 /* Data partition of the block cache */
+#define FS_STATS_INODES 2 /* Inode cache */
+#define FS_STATS_PINNED_BLOCKS 3 /* Block cache space reserved for pinned files */
+#define FS_STATS_CACHES 4
+
+#define FS_STATS_OPCODES 16 /* Room for every MSG_* packet type */
+#define FS_STATS_MRC_POINTS 16 /* Cache sizes each miss ratio curve estimates */
+
+struct FsCacheStats {
+    int capacity; /* Maximum number of entries */
+    int size; /* Entries in use */
+    int hits; /* Lookups served from the cache */
+    int misses; /* Lookups that had to read from disk */
+    int installs; /* Blocks added without reading their sector, 0 for inodes */
+    int evictions; /* Entries recycled for another block or inode */
+    int writebacks; /* Dirty entries written back */
+};
+
+/*
+ * Estimated hit rate of an LRU block cache partition at other sizes, from
+ * the lookups the server has seen. A partition of (i + 1) * bucket_blocks
+ * blocks would have hit hits[i] of the accesses lookups.
+ */
+struct FsMissRatioCurve {
+    int bucket_blocks; /* Size step between two points of the curve */
+    int accesses; /* Lookups the curve was estimated from */
+    int hits[FS_STATS_MRC_POINTS];
+};
+
+/*
+ * Compressed victim tier behind the block cache, all zero if the server was
+ * started without one. admitted * BLOCKSIZE / admitted_bytes is the
+ * compression ratio of the blocks it kept.
+ */
+struct FsVictimStats {
+    int budget; /* Bytes the tier may hold */
+    int used; /* Compressed bytes held */
+    int blocks; /* Blocks held */
+    int lookups; /* Block cache misses that looked in the tier */
+    int hits; /* Lookups served without reading the sector */
+    int admitted; /* Evicted blocks compressed and kept */
+    int admitted_bytes; /* Compressed size of the admitted blocks */
+    int rejected; /* Evicted blocks that did not compress enough */
+};
+
+struct FsStats {
+    struct FsCacheStats caches[FS_STATS_CACHES];
+    struct FsMissRatioCurve curves[FS_STATS_DATA_BLOCKS + 1]; /* One per block cache partition */
+    struct FsVictimStats victim;
+    int sector_reads; /* Sectors the server read, through the caches or not */
+    int sector_writes; /* Sectors the server wrote */
+    int sync_sectors; /* Dirty blocks Sync wrote back, in ascending sector order */
+    int sync_runs; /* Runs of consecutive sectors among them */
+    int requests[FS_STATS_OPCODES]; /* Requests received, indexed by packet type */
+    int free_inodes;
+    int free_blocks;
+    int pinned_files; /* Files pinned with PinFile */
+    int inode_fills; /* Inodes cached because another inode in their block missed */
+    int prefetched; /* Blocks read ahead of the requests that need them */
+    int prefetch_hits; /* Prefetched blocks a request then used */
+    int prefetch_wasted; /* Prefetched blocks evicted before any request used them */
+    int deferred_frees; /* Deleted files whose blocks are not yet free, see free_blocks */
+    int idle_rounds; /* Rounds of background work done while every process was blocked */
+    int unscanned_inodes; /* Inodes the free space scan has yet to reach, free_blocks is 0 until it ends */
+    int free_extents; /* Runs of consecutive free blocks */
+};
+
+/*
+ * How fragmented regular files are. Counting this reads every inode block
+ * and indirect block the caches don't hold, so it has a request of its own.
+ */
+struct FsFileRuns {
+    int files; /* Regular files holding at least one block */
+    int file_blocks; /* Blocks those files hold, holes and indirect blocks left out */
+    int file_runs; /* Runs of consecutive blocks, the seeks reading every file in order takes */
+    int sector_reads; /* Sectors read to count them, also counted in FsStats */
+};
+
+/*
+ * Copy the file server's statistics into stats. Return 0 on success, -1 on error.
+ */
+int GetFsStats(struct FsStats *stats);
+
+/*
+ * Count how fragmented the files are into runs. Return 0 on success, -1 on error.
+ */
+int GetFsFileRuns(struct FsFileRuns *runs);
+
+#endif //COMP421_LAB3_FSSTATS_H
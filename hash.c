@@ -0,0 +1,24 @@
+#include "hash.h"
+
+/** Knuth's multiplicative constant, 2^32 divided by the golden ratio */
+#define HASH_MULTIPLIER 2654435769u
+
+int GetHashSize(int capacity) {
+    /**
+     * Keep the table at most an eighth full. Most lookups in a cache smaller
+     * than the working set are misses, and a miss walks its whole chain.
+     */
+    int size = 2;
+    while (size < 8 * capacity) size <<= 1;
+    return size;
+}
+
+int HashIndex(int key_value, int hash_size) {
+    /**
+     * Fibonacci hashing: the multiply scatters consecutive keys across the
+     * high bits, so a sequential run of blocks lands in different buckets.
+     * hash_size is 2^k, so taking the top k bits needs a shift of clz + 1.
+     */
+    unsigned int hash = (unsigned int)key_value * HASH_MULTIPLIER;
+    return (int)(hash >> (__builtin_clz((unsigned int)hash_size) + 1));
+}
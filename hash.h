@@ -0,0 +1,19 @@
+#ifndef COMP421_LAB3_HASH_H
+#define COMP421_LAB3_HASH_H
+
+/**
+ * Computes the number of buckets for a cache's hash table
+ * @param capacity Maximum number of entries the cache will hold
+ * @return Power of two of at least eight times capacity, so chains stay short
+ */
+int GetHashSize(int capacity);
+
+/**
+ * Maps a block or inode number to a bucket in the hash table
+ * @param key_value Block or inode number, may be negative for dummy entries
+ * @param hash_size Number of buckets, must be a power of two
+ * @return Index of the bucket the key belongs to
+ */
+int HashIndex(int key_value, int hash_size);
+
+#endif //COMP421_LAB3_HASH_H
@@ -0,0 +1,234 @@
+/*
+ *  Host-side microbenchmark for the cache hash tables.
+ *
+ *  This is a Unix program (not a Yalnix program).  It replays block
+ *  number traces through a chained hash table shaped like the block
+ *  cache (LRU eviction, fixed capacity) and reports how long the chains
+ *  get and how much a lookup costs, both for the old key/8 bucketing
+ *  and for HashIndex from hash.c.
+ *
+ *  Usage: hashbench [capacity] [num_lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <comp421/filesystem.h>
+#include "hash.h"
+
+#define DEFAULT_LOOKUPS     1000000
+
+struct bench_entry {
+    int key;
+    int next_hash;
+    int prev_hash;
+    int next_lru;
+    int prev_lru;
+};
+
+struct bench_table {
+    struct bench_entry *entries;
+    int *buckets;
+    int bucket_count;
+    int capacity;
+    int size;
+    int top;
+    int base;
+    int (*index)(int, int); /* Bucketing function under test */
+};
+
+struct bench_result {
+    long probes;
+    long hits;
+    int max_chain;
+    double ns_per_lookup;
+};
+
+/**
+ * The bucketing the caches used before hash.c, kept for comparison
+ */
+int LegacyHashIndex(int key_value, int hash_size) {
+    (void)hash_size;
+    return key_value > 0 ? key_value/8 : key_value/(-8);
+}
+
+int BenchIndex(struct bench_table *table, int key) {
+    return table->index(key, table->bucket_count);
+}
+
+struct bench_table *CreateBenchTable(int capacity, int legacy) {
+    struct bench_table *table = malloc(sizeof(struct bench_table));
+    int i;
+    table->index = legacy ? LegacyHashIndex : HashIndex;
+    table->capacity = capacity;
+    table->bucket_count = legacy ? (NUMBLOCKS / 8) + 1 : GetHashSize(capacity);
+    table->entries = malloc(capacity * sizeof(struct bench_entry));
+    table->buckets = malloc(table->bucket_count * sizeof(int));
+    for (i = 0; i < table->bucket_count; i++) table->buckets[i] = -1;
+    table->size = 0;
+    table->top = -1;
+    table->base = -1;
+    return table;
+}
+
+void FreeBenchTable(struct bench_table *table) {
+    free(table->entries);
+    free(table->buckets);
+    free(table);
+}
+
+/**
+ * Moves an entry to the top of the recency list
+ */
+void RaiseBenchEntry(struct bench_table *table, int index) {
+    struct bench_entry *e = &table->entries[index];
+    if (table->top == index) return;
+    if (e->prev_lru >= 0) table->entries[e->prev_lru].next_lru = e->next_lru;
+    if (e->next_lru >= 0) table->entries[e->next_lru].prev_lru = e->prev_lru;
+    if (table->base == index) table->base = e->prev_lru;
+    e->prev_lru = -1;
+    e->next_lru = table->top;
+    if (table->top >= 0) table->entries[table->top].prev_lru = index;
+    table->top = index;
+    if (table->base < 0) table->base = index;
+}
+
+/**
+ * Walks the chain for key, counting every entry visited
+ * @return Index of the entry or -1 on a miss
+ */
+int LookUpBenchEntry(struct bench_table *table, int key, long *probes) {
+    int index;
+    for (index = table->buckets[BenchIndex(table, key)]; index >= 0; index = table->entries[index].next_hash) {
+        (*probes)++;
+        if (table->entries[index].key == key) return index;
+    }
+    return -1;
+}
+
+/**
+ * Inserts key, evicting the least recently used entry when full
+ */
+void AddBenchEntry(struct bench_table *table, int key) {
+    int index;
+    int bucket;
+    struct bench_entry *e;
+
+    if (table->size == table->capacity) {
+        index = table->base;
+        e = &table->entries[index];
+        if (e->prev_hash >= 0) table->entries[e->prev_hash].next_hash = e->next_hash;
+        else table->buckets[BenchIndex(table, e->key)] = e->next_hash;
+        if (e->next_hash >= 0) table->entries[e->next_hash].prev_hash = e->prev_hash;
+    } else {
+        index = table->size++;
+        e = &table->entries[index];
+        e->prev_lru = -1;
+        e->next_lru = -1;
+    }
+
+    e->key = key;
+    bucket = BenchIndex(table, key);
+    e->prev_hash = -1;
+    e->next_hash = table->buckets[bucket];
+    if (e->next_hash >= 0) table->entries[e->next_hash].prev_hash = index;
+    table->buckets[bucket] = index;
+    RaiseBenchEntry(table, index);
+}
+
+int LongestChain(struct bench_table *table) {
+    int longest = 0;
+    int bucket;
+    int length;
+    int index;
+    for (bucket = 0; bucket < table->bucket_count; bucket++) {
+        length = 0;
+        for (index = table->buckets[bucket]; index >= 0; index = table->entries[index].next_hash) length++;
+        if (length > longest) longest = length;
+    }
+    return longest;
+}
+
+/**
+ * Replays a trace through the table.  The lookup loop is timed on its own
+ * against a warm table so that eviction bookkeeping does not pollute it.
+ */
+struct bench_result RunTrace(int *trace, int length, int capacity, int legacy) {
+    struct bench_result result;
+    struct bench_table *table = CreateBenchTable(capacity, legacy);
+    struct timespec start;
+    struct timespec end;
+    long ignored = 0;
+    int i;
+    int found;
+
+    result.probes = 0;
+    result.hits = 0;
+    result.max_chain = 0;
+    for (i = 0; i < length; i++) {
+        found = LookUpBenchEntry(table, trace[i], &result.probes);
+        if (found >= 0) {
+            result.hits++;
+            RaiseBenchEntry(table, found);
+        } else {
+            AddBenchEntry(table, trace[i]);
+        }
+        if ((i & 63) == 0) {
+            found = LongestChain(table);
+            if (found > result.max_chain) result.max_chain = found;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < length; i++) {
+        LookUpBenchEntry(table, trace[i], &ignored);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result.ns_per_lookup = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / length;
+
+    FreeBenchTable(table);
+    return result;
+}
+
+void PrintResult(char *trace_name, char *hash_name, struct bench_result result, int length) {
+    printf("%-10s %-10s %10.2f %10d %10.1f%% %10.2f\n", trace_name, hash_name,
+           (double)result.probes / length, result.max_chain,
+           100.0 * result.hits / length, result.ns_per_lookup);
+}
+
+int main(int argc, char **argv) {
+    int capacity = BLOCK_CACHESIZE;
+    int length = DEFAULT_LOOKUPS;
+    int *sequential;
+    int *random;
+    int i;
+
+    if (argc > 1 && sscanf(argv[1], "%d", &capacity) != 1) {
+        fprintf(stderr, "usage: hashbench [capacity] [num_lookups]\n");
+        exit(1);
+    }
+    if (argc > 2 && sscanf(argv[2], "%d", &length) != 1) {
+        fprintf(stderr, "usage: hashbench [capacity] [num_lookups]\n");
+        exit(1);
+    }
+
+    /* Sequential trace sweeps the whole disk, random trace is uniform */
+    sequential = malloc(length * sizeof(int));
+    random = malloc(length * sizeof(int));
+    srand(421);
+    for (i = 0; i < length; i++) {
+        sequential[i] = (i % (NUMBLOCKS - 1)) + 1;
+        random[i] = (rand() % (NUMBLOCKS - 1)) + 1;
+    }
+
+    printf("capacity %d, %d lookups per trace\n", capacity, length);
+    printf("%-10s %-10s %10s %10s %11s %10s\n", "trace", "hash", "probes/op", "max chain", "hit rate", "ns/op");
+    PrintResult("sequential", "key/8", RunTrace(sequential, length, capacity, 1), length);
+    PrintResult("sequential", "HashIndex", RunTrace(sequential, length, capacity, 0), length);
+    PrintResult("random", "key/8", RunTrace(random, length, capacity, 1), length);
+    PrintResult("random", "HashIndex", RunTrace(random, length, capacity, 0), length);
+
+    free(sequential);
+    free(random);
+    exit(0);
+}
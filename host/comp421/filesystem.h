@@ -0,0 +1,6 @@
+/*
+ *  The file system layout is the same on the host, see filesystem.h at the
+ *  top of the tree.
+ */
+
+#include "../../filesystem.h"
@@ -0,0 +1,13 @@
+/*
+ *  Stand-in for the Yalnix hardware header, so the caches can be built and
+ *  tested on a plain Unix host.  Only the disk geometry is provided; it must
+ *  match $(PUBLIC_DIR)/include/comp421/hardware.h.
+ */
+
+#ifndef _hardware_h
+#define _hardware_h
+
+#define SECTORSIZE  512     /* Bytes per disk sector */
+#define NUMSECTORS  1426    /* Sectors on the disk */
+
+#endif /* _hardware_h */
@@ -0,0 +1,15 @@
+/*
+ *  Stand-in for the Yalnix kernel call header on a plain Unix host.  Only
+ *  the disk calls the caches make are declared; the host program linking
+ *  them provides both, usually over an in-memory disk (see cachebench.c).
+ */
+
+#ifndef _yalnix_h
+#define _yalnix_h
+
+#define ERROR   (-1)
+
+int ReadSector(int, void *);
+int WriteSector(int, void *);
+
+#endif /* _yalnix_h */
@@ -7,6 +7,8 @@
 #include "path.h"
 #include "packet.h"
 #include "fd.h"
+#include "fsstats.h"
+#include "cachectl.h"
 
 int current_inum = ROOTINODE;
 
@@ -317,6 +319,7 @@ int Write(int fd_id, void *buf, int size) {
         else if (result == -2) fprintf(stderr, "[Error] Trying to write to non-regular file.\n");
         else if (result == -3) fprintf(stderr, "[Error] Reuse count has changed. Please close this fd.\n");
         else if (result == -4) fprintf(stderr, "[Error] Not enough block left.\n");
+        else if (result == -5) fprintf(stderr, "[Error] Could not copy the buffer to write.\n");
         return -1;
     }
     fd->pos += result;
@@ -567,9 +570,13 @@ int MkDir(char *pathname) {
     free(parent_inum);
     free(stat);
 
-    /* If returned inum is 0, there is an error with file creation */
-    if (new_inum == 0) {
-        fprintf(stderr, "[Error] File creation error\n");
+    /* If returned inum is 0 or negative, there is an error with file creation */
+    if (new_inum <= 0) {
+        if (new_inum == 0) fprintf(stderr, "[Error] File creation error\n");
+        else if (new_inum == -1) fprintf(stderr, "[Error] Cannot create directory in non-directory.\n");
+        else if (new_inum == -2) fprintf(stderr, "[Error] Directory has reached max size limit.\n");
+        else if (new_inum == -3) fprintf(stderr, "[Error] Not enough inode left.\n");
+        else if (new_inum == -4) fprintf(stderr, "[Error] Not enough block left.\n");
         return -1;
     }
 
@@ -721,3 +728,138 @@ int Shutdown() {
     free(packet);
     return 0;
 }
+
+/**
+ * Copies the file server's statistics into stats
+ */
+int GetFsStats(struct FsStats *stats) {
+    if (stats == NULL) {
+        fprintf(stderr, "[Error] Invalid stats buffer.\n");
+        return -1;
+    }
+
+    int result;
+    DataPacket *packet = malloc(PACKET_SIZE);
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_STATS;
+    packet->arg1 = sizeof(struct FsStats);
+    packet->pointer = (void *)stats;
+    Send(packet, -FILE_SERVER);
+
+    result = packet->arg1;
+    free(packet);
+
+    if (result < 0) {
+        fprintf(stderr, "[Error] File server could not return its statistics.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Has the file server count how fragmented the files are into runs
+ */
+int GetFsFileRuns(struct FsFileRuns *runs) {
+    if (runs == NULL) {
+        fprintf(stderr, "[Error] Invalid file runs buffer.\n");
+        return -1;
+    }
+
+    int result;
+    DataPacket *packet = malloc(PACKET_SIZE);
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_FILE_RUNS;
+    packet->arg1 = sizeof(struct FsFileRuns);
+    packet->pointer = (void *)runs;
+    Send(packet, -FILE_SERVER);
+
+    result = packet->arg1;
+    free(packet);
+
+    if (result < 0) {
+        fprintf(stderr, "[Error] File server could not count file runs.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Helper that asks the file server to pin (pin = 1) or unpin (pin = 0) a file
+ */
+int SendPinRequest(char *pathname, int pin) {
+    struct Stat stat;
+    int result;
+
+    if (AssertPathname(pathname) < 0) return -1;
+
+    int *parent_inum = malloc(sizeof(int));
+    result = IterateFilePath(pathname, parent_inum, &stat, NULL, NULL);
+    free(parent_inum);
+    if (result < 0) {
+        fprintf(stderr, "[Error] Path not found\n");
+        return -1;
+    }
+
+    DataPacket *packet = malloc(PACKET_SIZE);
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_PIN_FILE;
+    packet->arg1 = stat.inum;
+    packet->arg2 = pin;
+    Send(packet, -FILE_SERVER);
+
+    result = packet->arg1;
+    free(packet);
+
+    if (result < 0) {
+        fprintf(stderr, "[Error] File server could not %s the file.\n", pin ? "pin" : "unpin");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Keeps every block of a file cached, see cachectl.h
+ */
+int PinFile(char *pathname) {
+    return SendPinRequest(pathname, 1);
+}
+
+/**
+ * Lets the blocks PinFile kept cached be evicted again
+ */
+int UnpinFile(char *pathname) {
+    return SendPinRequest(pathname, 0);
+}
+
+/**
+ * Passes access pattern advice for an open file to the server, see cachectl.h
+ */
+int Advise(int fd_id, int offset, int len, int advice) {
+    FileDescriptor *fd = GetFileDescriptor(fd_id);
+    if (fd == NULL) {
+        fprintf(stderr, "[Error] Provided fd is not open.\n");
+        return -1;
+    }
+    if (offset < 0 || len < 0 || advice < ADVISE_NORMAL || advice > ADVISE_DONTNEED) {
+        fprintf(stderr, "[Error] Invalid arguments on offset, len or advice.\n");
+        return -1;
+    }
+
+    int result;
+    DataPacket *packet = malloc(PACKET_SIZE);
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_ADVISE;
+    packet->arg1 = fd->inum;
+    packet->arg2 = offset;
+    packet->arg3 = len;
+    packet->arg4 = advice;
+    Send(packet, -FILE_SERVER);
+    result = packet->arg1;
+    free(packet);
+
+    if (result < 0) {
+        fprintf(stderr, "[Error] File server rejected the advice.\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ *  Create an empty Yalnix file system on the Yalnix DISK.
+ *
+ *  This is a Unix program (not a Yalnix program).  It creates a Yalnix
+ *  file system in the Unix file named "DISK", like samples-lab3/mkyfs.c,
+ *  and also writes the free block and free inode bitmaps described in
+ *  fsbitmap.h, so the server can mount without scanning every inode.
+ *  The bitmaps take the blocks right after the inode blocks, and the
+ *  root directory's block follows them.
+ *
+ *  Usage: mkyfs [-n] [num_inodes]
+ *
+ *  -n leaves the bitmaps out and lays the disk out exactly like the
+ *  original mkyfs.  The default number of inodes if num_inodes is not
+ *  specified is given by the DEFAULT_NUM_INODES constant below.
+ *
+ *  RUN THIS COMMAND AS A UNIX PROGRAM, NOT AS A YALNIX PROGRAM.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <comp421/filesystem.h>
+#include "fsbitmap.h"
+
+#define	INODES_PER_BLOCK	(BLOCKSIZE/INODESIZE)
+
+#define DISK_FILE_NAME		"DISK"
+#define DEFAULT_NUM_INODES	(6 * INODES_PER_BLOCK - 1)
+
+union {
+    struct fs_header hdr;
+    struct inode inode[INODES_PER_BLOCK];
+    char buf[BLOCKSIZE];
+} block;
+
+/*
+ *  Write size bytes at block number block_num, or give up and remove the
+ *  half made DISK
+ */
+void
+WriteBlocks(int disk, int block_num, void *buf, int size, char *what)
+{
+    lseek(disk, (off_t)block_num * BLOCKSIZE, SEEK_SET);
+    if (write(disk, buf, size) != size) {
+	perror(what);
+	unlink(DISK_FILE_NAME);
+	exit(1);
+    }
+}
+
+void
+SetBit(unsigned char *bitmap, int n)
+{
+    bitmap[n / 8] |= 1 << (n % 8);
+}
+
+int
+main(int argc, char **argv)
+{
+    int disk;
+    int num_inodes = DEFAULT_NUM_INODES;
+    int bitmaps = 1;
+    int i;
+    struct inode *inodes;
+    struct fs_bitmap_header *header;
+    int inodes_size;
+    int next_block;
+    int block_bitmap_blocks;
+    int inode_bitmap_blocks;
+    unsigned char *block_bitmap;
+    unsigned char *inode_bitmap;
+    struct dir_entry root[2];
+
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+	bitmaps = 0;
+	argc--;
+	argv++;
+    }
+    if (argc > 1) {
+	if (sscanf(argv[1], "%d", &num_inodes) != 1 || num_inodes < 1) {
+	    fprintf(stderr, "usage: mkyfs [-n] [num_inodes]\n");
+	    exit(1);
+	}
+    }
+
+    if ((disk = creat(DISK_FILE_NAME, 0666)) < 0) {
+	perror(DISK_FILE_NAME);
+	exit(1);
+    }
+
+    inodes_size = (num_inodes + 1) * INODESIZE;
+    /* force rounded up to BLOCKSIZE multiple */
+    inodes_size = (inodes_size + BLOCKSIZE - 1) & ~(BLOCKSIZE - 1);
+    inodes = (struct inode *)calloc(1, inodes_size);
+    header = (struct fs_bitmap_header *)inodes;
+    next_block = inodes_size / BLOCKSIZE + 1;
+
+    header->num_blocks = NUMSECTORS;
+    header->num_inodes = num_inodes;
+
+    block_bitmap_blocks = BITMAP_BLOCKS(NUMSECTORS);
+    inode_bitmap_blocks = BITMAP_BLOCKS(num_inodes + 1);
+    block_bitmap = calloc(block_bitmap_blocks, BLOCKSIZE);
+    inode_bitmap = calloc(inode_bitmap_blocks, BLOCKSIZE);
+    if (bitmaps) {
+	header->bitmap_magic = FS_BITMAP_MAGIC;
+	header->block_bitmap = next_block;
+	header->inode_bitmap = next_block + block_bitmap_blocks;
+	header->clean = 1;
+	next_block += block_bitmap_blocks + inode_bitmap_blocks;
+    }
+
+    inodes[1].type = INODE_DIRECTORY;
+    inodes[1].nlink = 2;
+    inodes[1].reuse = 1;
+    inodes[1].size = 2 * sizeof(struct dir_entry);
+    inodes[1].direct[0] = next_block;
+
+    for (i = 2; i <= num_inodes; i++) {
+	inodes[i].type = INODE_FREE;
+	/* all other fields are automatically 0 */
+    }
+
+    WriteBlocks(disk, 1, inodes, inodes_size, "write inodes");
+
+    memset((void *)root, '\0', sizeof(root));
+    root[0].inum = ROOTINODE;
+    root[0].name[0] = '.';
+    root[1].inum = ROOTINODE;
+    root[1].name[0] = '.';
+    root[1].name[1] = '.';
+
+    WriteBlocks(disk, next_block, root, sizeof(root), "write root");
+
+    /*
+     *  Everything up to and including the root directory's block is in
+     *  use: the boot block, the inode blocks and the bitmaps themselves.
+     *  So are inode 0, which holds the header, and the root inode.
+     */
+    if (bitmaps) {
+	for (i = 0; i <= next_block; i++)
+	    SetBit(block_bitmap, i);
+	SetBit(inode_bitmap, 0);
+	SetBit(inode_bitmap, ROOTINODE);
+	WriteBlocks(disk, header->block_bitmap, block_bitmap, block_bitmap_blocks * BLOCKSIZE, "write block bitmap");
+	WriteBlocks(disk, header->inode_bitmap, inode_bitmap, inode_bitmap_blocks * BLOCKSIZE, "write inode bitmap");
+    }
+
+    /*
+     *  Seek to the last block of the DISK and write it full of zeros.
+     *  In Unix, this leaves a "hole" in the file, which will act
+     *  exactly as if it had been written full of zeros.  When reading
+     *  from this space skipped over here, Unix will read it as all
+     *  zeros.  By making this a hole, it is faster to run mkyfs,
+     *  and it saves real Unix disk space since a hole doesn't consume
+     *  physical disk blocks.
+     */
+    memset((void *)&block, '\0', BLOCKSIZE);
+    WriteBlocks(disk, NUMSECTORS - 1, &block, BLOCKSIZE, "write last zero");
+
+    exit(0);
+}
@@ -0,0 +1,321 @@
+/*
+ *  Host-side benchmark for building the free block list at mount.
+ *
+ *  This is a Unix program (not a Yalnix program).  It makes synthetic
+ *  file system images in memory, from the size of the Yalnix disk up to
+ *  max_blocks blocks, each filled to FILL_PERCENT with files of random
+ *  size whose blocks are scattered over the disk, some with holes.  For
+ *  every image it times the mark and sweep of freelist.c against the old
+ *  construction, which searched the candidate array once per used block,
+ *  and checks that the free extents hold exactly the blocks no file uses.
+ *  Before that it checks the extent allocator against a bitmap over a long
+ *  run of random allocations and frees.
+ *
+ *  The old construction is only run up to LEGACY_MAX_BLOCKS, it grows
+ *  with the square of the disk.  It is reproduced here with its search
+ *  bounded to the array, the original ran off the end looking for holes.
+ *
+ *  Usage: mountbench [max_blocks]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <comp421/filesystem.h>
+#include "fsbitmap.h"
+#include "freelist.h"
+
+#define DEFAULT_MAX_BLOCKS  (NUMSECTORS * 64)
+#define LEGACY_MAX_BLOCKS   (NUMSECTORS * 32)
+#define BLOCK_POINTERS      (int)(BLOCKSIZE / sizeof(int))
+#define FILL_PERCENT        95  /* Share of the data blocks the files use */
+#define HOLE_PERCENT        5   /* Share of file blocks left as holes */
+#define BLOCKS_PER_INODE    8   /* Disk blocks per inode of an image */
+#define ALLOCATOR_STEPS     200000
+
+struct image {
+    int num_blocks;
+    int num_inodes;
+    int first_data_block; /* First block after the header and inodes */
+    struct inode *inodes; /* Indexed by inode number, 0 unused */
+    int **indirect_blocks; /* Contents of each inode's indirect block, NULL if none */
+    unsigned char *expected; /* Blocks the image uses, for checking */
+    int used_blocks;
+};
+
+unsigned int rng_state = 421;
+
+unsigned int NextRandom() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+double ElapsedMs(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * Makes an image of num_blocks blocks. Files take blocks from a shuffled
+ * list of the data blocks until FILL_PERCENT of them are used.
+ */
+struct image *MakeImage(int num_blocks) {
+    struct image *image = malloc(sizeof(struct image));
+    int inode_blocks;
+    int data_blocks;
+    int *order;
+    int next = 0;
+    int limit;
+    int block_count;
+    int inum;
+    int i;
+    int j;
+    int t;
+
+    image->num_blocks = num_blocks;
+    image->num_inodes = num_blocks / BLOCKS_PER_INODE;
+    inode_blocks = ((image->num_inodes + 1) * INODESIZE + BLOCKSIZE - 1) / BLOCKSIZE;
+    image->first_data_block = 1 + inode_blocks;
+    image->inodes = calloc(image->num_inodes + 1, sizeof(struct inode));
+    image->indirect_blocks = calloc(image->num_inodes + 1, sizeof(int *));
+    image->expected = calloc(BITMAP_BLOCKS(num_blocks), BLOCKSIZE);
+    for (i = 0; i < image->first_data_block; i++) SetBitmapBit(image->expected, i, 1);
+
+    data_blocks = num_blocks - image->first_data_block;
+    order = malloc(data_blocks * sizeof(int));
+    for (i = 0; i < data_blocks; i++) order[i] = image->first_data_block + i;
+    for (i = data_blocks - 1; i > 0; i--) {
+        j = NextRandom() % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    limit = (long)data_blocks * FILL_PERCENT / 100;
+    for (inum = 1; inum <= image->num_inodes; inum++) {
+        struct inode *inode = &image->inodes[inum];
+        block_count = 1 + NextRandom() % (NUM_DIRECT + BLOCK_POINTERS);
+        if (next + block_count + 1 > limit) {
+            inode->type = INODE_FREE;
+            continue;
+        }
+        inode->type = INODE_REGULAR;
+        inode->nlink = 1;
+        inode->size = (block_count - 1) * BLOCKSIZE + 1 + NextRandom() % BLOCKSIZE;
+        if (block_count > NUM_DIRECT) {
+            inode->indirect = order[next++];
+            SetBitmapBit(image->expected, inode->indirect, 1);
+            image->indirect_blocks[inum] = calloc(BLOCK_POINTERS, sizeof(int));
+        }
+        for (i = 0; i < block_count; i++) {
+            if (NextRandom() % 100 < HOLE_PERCENT) continue;
+            t = order[next++];
+            SetBitmapBit(image->expected, t, 1);
+            if (i < NUM_DIRECT) inode->direct[i] = t;
+            else image->indirect_blocks[inum][i - NUM_DIRECT] = t;
+        }
+    }
+    image->used_blocks = image->first_data_block + next;
+
+    free(order);
+    return image;
+}
+
+void FreeImage(struct image *image) {
+    int i;
+    for (i = 0; i <= image->num_inodes; i++) free(image->indirect_blocks[i]);
+    free(image->indirect_blocks);
+    free(image->inodes);
+    free(image->expected);
+    free(image);
+}
+
+/**
+ * The free block list the way GetFreeBlockList builds it
+ */
+struct extent_list *MarkAndSweep(struct image *image) {
+    unsigned char *used = calloc(BITMAP_BLOCKS(image->num_blocks), BLOCKSIZE);
+    struct extent_list *free_list;
+    int i;
+
+    MarkBlockRange(used, image->num_blocks, 0, image->first_data_block);
+    for (i = 1; i <= image->num_inodes; i++)
+        MarkFileBlocks(used, image->num_blocks, &image->inodes[i], image->indirect_blocks[i]);
+    free_list = SweepFreeExtents(used, image->num_blocks);
+    free(used);
+    return free_list;
+}
+
+/**
+ * The old helper: find value in arr and swap it to index
+ */
+void LegacySearchAndSwap(int arr[], int size, int value, int index) {
+    int i;
+    for (i = index; i < size; i++) {
+        if (arr[i] == value) {
+            arr[i] = arr[index];
+            arr[index] = value;
+            return;
+        }
+    }
+}
+
+/**
+ * The old construction: every block a file's size covers, holes included,
+ * is counted busy and searched for among the candidates
+ * @return Number of blocks it would have put on the free list
+ */
+int LegacyFreeBlockCount(struct image *image) {
+    int block_count = image->num_blocks - image->first_data_block;
+    int *buffer = malloc(block_count * sizeof(int));
+    int busy_blocks = 0;
+    struct inode *scan;
+    int pos;
+    int i;
+    int j;
+
+    for (i = 0; i < block_count; i++) buffer[i] = i + image->first_data_block;
+    for (i = 1; i <= image->num_inodes; i++) {
+        scan = &image->inodes[i];
+        for (j = 0, pos = 0; pos < scan->size && j < NUM_DIRECT; j++, pos += BLOCKSIZE)
+            LegacySearchAndSwap(buffer, block_count, scan->direct[j], busy_blocks++);
+        if (pos < scan->size) {
+            LegacySearchAndSwap(buffer, block_count, scan->indirect, busy_blocks++);
+            for (j = 0; j < BLOCK_POINTERS && pos < scan->size; j++, pos += BLOCKSIZE)
+                LegacySearchAndSwap(buffer, block_count, image->indirect_blocks[i][j], busy_blocks++);
+        }
+    }
+    free(buffer);
+    return block_count - busy_blocks;
+}
+
+/**
+ * Checks that the extents are sorted, never touch, and add up to free_blocks
+ */
+int CheckExtents(struct extent_list *list, int num_blocks) {
+    int total = 0;
+    int end = 0;
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        if (list->extents[i].length <= 0 || list->extents[i].start <= end) return 0;
+        end = list->extents[i].start + list->extents[i].length;
+        if (end > num_blocks) return 0;
+        total += list->extents[i].length;
+    }
+    return total == list->free_blocks;
+}
+
+/**
+ * Checks that free_list holds exactly the blocks the image does not use
+ */
+int CheckFreeList(struct image *image, struct extent_list *free_list) {
+    int i;
+    int n;
+
+    if (!CheckExtents(free_list, image->num_blocks)) return 0;
+    if (free_list->free_blocks != image->num_blocks - image->used_blocks) return 0;
+    for (i = 0; i < free_list->count; i++) {
+        for (n = free_list->extents[i].start; n < free_list->extents[i].start + free_list->extents[i].length; n++) {
+            if (GetBitmapBit(image->expected, n)) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Takes and gives back random blocks through the extent allocator, checking
+ * it against a bitmap after every step. A block must be free when it is
+ * taken, and the block after prev_block must be taken whenever it is free.
+ */
+int CheckAllocator(int num_blocks, int steps) {
+    unsigned char *used = calloc(BITMAP_BLOCKS(num_blocks), BLOCKSIZE);
+    struct extent_list *list;
+    int prev_block;
+    int expected;
+    int n;
+    int i;
+    int ok = 1;
+
+    SetBitmapBit(used, 0, 1);
+    list = SweepFreeExtents(used, num_blocks);
+    for (i = 0; i < steps && ok; i++) {
+        n = 1 + NextRandom() % (num_blocks - 1);
+        if (GetBitmapBit(used, n)) {
+            FreeExtentBlock(list, n);
+            SetBitmapBit(used, n, 0);
+        } else if (list->free_blocks > 0) {
+            prev_block = NextRandom() % 2 ? n : 0;
+            expected = prev_block > 0 && prev_block + 1 < num_blocks && !GetBitmapBit(used, prev_block + 1) ? prev_block + 1 : 0;
+            n = AllocExtentBlock(list, prev_block, 1 + NextRandom() % 16);
+            if (n <= 0 || GetBitmapBit(used, n) || (expected > 0 && n != expected)) ok = 0;
+            else SetBitmapBit(used, n, 1);
+        }
+        if (!CheckExtents(list, num_blocks)) ok = 0;
+    }
+    for (n = 1; n < num_blocks && ok; n++) {
+        if (!GetBitmapBit(used, n)) FreeExtentBlock(list, n);
+    }
+    free(used);
+    free(list->extents);
+    free(list);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int max_blocks = DEFAULT_MAX_BLOCKS;
+    struct image *image;
+    struct extent_list *free_list;
+    struct timespec start;
+    struct timespec end;
+    double mark_ms;
+    double legacy_ms;
+    int legacy_free;
+    int num_blocks;
+    int ok;
+
+    if (argc > 1 && (sscanf(argv[1], "%d", &max_blocks) != 1 || max_blocks < NUMSECTORS)) {
+        fprintf(stderr, "usage: mountbench [max_blocks]\n");
+        exit(1);
+    }
+
+    if (!CheckAllocator(NUMSECTORS, ALLOCATOR_STEPS)) {
+        fprintf(stderr, "mountbench: extent allocator check failed\n");
+        exit(1);
+    }
+
+    printf("%10s %8s %10s %11s %13s %12s %10s\n", "blocks", "inodes", "free", "legacy free", "mark+sweep ms", "legacy ms", "ns/block");
+    for (num_blocks = NUMSECTORS; num_blocks <= max_blocks; num_blocks *= 2) {
+        image = MakeImage(num_blocks);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        free_list = MarkAndSweep(image);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        mark_ms = ElapsedMs(&start, &end);
+        ok = CheckFreeList(image, free_list);
+        free(free_list->extents);
+        free(free_list);
+
+        printf("%10d %8d %10d ", num_blocks, image->num_inodes, image->num_blocks - image->used_blocks);
+        if (num_blocks <= LEGACY_MAX_BLOCKS) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            legacy_free = LegacyFreeBlockCount(image);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            legacy_ms = ElapsedMs(&start, &end);
+            printf("%11d %13.3f %12.3f", legacy_free, mark_ms, legacy_ms);
+        } else {
+            printf("%11s %13.3f %12s", "-", mark_ms, "-");
+        }
+        printf(" %10.2f\n", mark_ms * 1e6 / num_blocks);
+
+        FreeImage(image);
+        if (!ok) {
+            fprintf(stderr, "mountbench: wrong free list for %d blocks\n", num_blocks);
+            exit(1);
+        }
+    }
+
+    exit(0);
+}
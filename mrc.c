@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include "hash.h"
+#include "mrc.h"
+
+struct miss_ratio_curve* CreateMissRatioCurve(int capacity) {
+    struct miss_ratio_curve* mrc = calloc(1, sizeof(struct miss_ratio_curve));
+    mrc->bucket_blocks = (capacity * MRC_SIZE_FACTOR + MRC_BUCKETS - 1) / MRC_BUCKETS;
+    mrc->capacity = mrc->bucket_blocks * MRC_BUCKETS;
+    mrc->hash_size = GetHashSize(mrc->capacity);
+    mrc->hash_set = calloc(mrc->hash_size, sizeof(struct mrc_entry*));
+    mrc->entries = calloc(mrc->capacity, sizeof(struct mrc_entry));
+    return mrc;
+}
+
+/**
+ * Private helper that unlinks an entry from the stack and from its bucket
+ */
+void RemoveMrcEntry(struct miss_ratio_curve* mrc, struct mrc_entry* entry) {
+    if (mrc->tails[entry->bucket] == entry) {
+        /** Buckets are contiguous, the entry above is either in the same bucket or the one before */
+        if (entry->prev_lru != NULL && entry->prev_lru->bucket == entry->bucket) mrc->tails[entry->bucket] = entry->prev_lru;
+        else mrc->tails[entry->bucket] = NULL;
+    }
+    mrc->counts[entry->bucket]--;
+
+    if (entry->prev_lru != NULL) entry->prev_lru->next_lru = entry->next_lru;
+    else mrc->top = entry->next_lru;
+    if (entry->next_lru != NULL) entry->next_lru->prev_lru = entry->prev_lru;
+    else mrc->base = entry->prev_lru;
+}
+
+void RecordBlockAccess(struct miss_ratio_curve* mrc, int block_number) {
+    int index = HashIndex(block_number, mrc->hash_size);
+    struct mrc_entry* entry;
+    int i;
+
+    mrc->accesses++;
+    for (entry = mrc->hash_set[index]; entry != NULL; entry = entry->next_hash) {
+        if (entry->block_number == block_number) break;
+    }
+
+    if (entry != NULL) {
+        mrc->hits[entry->bucket]++;
+        RemoveMrcEntry(mrc, entry);
+    } else {
+        if (mrc->size < mrc->capacity) {
+            entry = &mrc->entries[mrc->size++];
+        } else {
+            /** Forget the least recently looked up number */
+            entry = mrc->base;
+            RemoveMrcEntry(mrc, entry);
+            if (entry->prev_hash != NULL) entry->prev_hash->next_hash = entry->next_hash;
+            else mrc->hash_set[HashIndex(entry->block_number, mrc->hash_size)] = entry->next_hash;
+            if (entry->next_hash != NULL) entry->next_hash->prev_hash = entry->prev_hash;
+        }
+        entry->block_number = block_number;
+        entry->prev_hash = NULL;
+        entry->next_hash = mrc->hash_set[index];
+        if (entry->next_hash != NULL) entry->next_hash->prev_hash = entry;
+        mrc->hash_set[index] = entry;
+    }
+
+    /** Push onto the first bucket */
+    entry->bucket = 0;
+    entry->prev_lru = NULL;
+    entry->next_lru = mrc->top;
+    if (mrc->top != NULL) mrc->top->prev_lru = entry;
+    else mrc->base = entry;
+    mrc->top = entry;
+    if (mrc->tails[0] == NULL) mrc->tails[0] = entry;
+    mrc->counts[0]++;
+
+    /** Every overfull bucket passes its last entry down to the next one */
+    for (i = 0; i < MRC_BUCKETS - 1 && mrc->counts[i] > mrc->bucket_blocks; i++) {
+        entry = mrc->tails[i];
+        entry->bucket = i + 1;
+        if (mrc->tails[i + 1] == NULL) mrc->tails[i + 1] = entry;
+        mrc->counts[i + 1]++;
+        mrc->tails[i] = entry->prev_lru;
+        mrc->counts[i]--;
+    }
+}
+
+void FillMissRatioCurve(struct FsMissRatioCurve* stats, struct miss_ratio_curve* mrc) {
+    int hits = 0;
+    int i;
+
+    stats->bucket_blocks = mrc->bucket_blocks;
+    stats->accesses = mrc->accesses;
+    for (i = 0; i < MRC_BUCKETS; i++) {
+        hits += mrc->hits[i];
+        stats->hits[i] = hits;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef COMP421_LAB3_MRC_H
+#define COMP421_LAB3_MRC_H
+
+#include "fsstats.h"
+
+#define MRC_BUCKETS FS_STATS_MRC_POINTS //Number of hypothetical cache sizes estimated
+#define MRC_SIZE_FACTOR 4 //Largest size estimated, as a multiple of the partition's capacity
+
+/**
+ * Estimates the miss ratio curve of a block cache partition from its live
+ * lookups. Every looked up block number is kept on an LRU stack that is
+ * MRC_SIZE_FACTOR times longer than the partition, so numbers of blocks the
+ * partition already evicted stay on it as ghosts. The stack is cut into
+ * MRC_BUCKETS buckets of bucket_blocks entries. A lookup that finds its
+ * number in bucket i would have hit in an LRU cache of (i + 1) *
+ * bucket_blocks blocks or more. Each entry knows its bucket, so a lookup
+ * only moves the last entry of each bucket above the one it was found in.
+ */
+struct mrc_entry {
+    int block_number;
+    int bucket; //Bucket of the stack the entry is in
+    struct mrc_entry* prev_lru; //More recently used entry
+    struct mrc_entry* next_lru; //Less recently used entry
+    struct mrc_entry* prev_hash;
+    struct mrc_entry* next_hash;
+};
+
+struct miss_ratio_curve {
+    struct mrc_entry* top; //Most recently looked up
+    struct mrc_entry* base; //Least recently looked up
+    struct mrc_entry* tails[MRC_BUCKETS]; //Least recently used entry of each bucket
+    int counts[MRC_BUCKETS]; //Entries in each bucket
+    int hits[MRC_BUCKETS]; //Lookups whose number was found in each bucket
+    int accesses; //Lookups recorded
+    int bucket_blocks; //Entries per bucket
+    int size; //Entries on the stack
+    int capacity; //MRC_BUCKETS * bucket_blocks
+    int hash_size;
+    struct mrc_entry** hash_set;
+    struct mrc_entry* entries; //Preallocated entries, one per stack slot
+};
+
+/**
+ * Creates the estimator for a partition holding capacity blocks
+ */
+struct miss_ratio_curve* CreateMissRatioCurve(int capacity);
+
+/**
+ * Records a lookup of block_number and moves it to the top of the stack
+ */
+void RecordBlockAccess(struct miss_ratio_curve* mrc, int block_number);
+
+/**
+ * Copies the curve into stats, hits[i] being the lookups an LRU cache of
+ * (i + 1) * bucket_blocks blocks would have hit
+ */
+void FillMissRatioCurve(struct FsMissRatioCurve* stats, struct miss_ratio_curve* mrc);
+
+#endif //COMP421_LAB3_MRC_H
@@ -36,6 +36,22 @@
 // Receive DataPacket
 #define MSG_SYNC 9
 
+// Send: DataPacket (arg1 = sizeof(struct FsStats), pointer = struct FsStats *)
+// Receive: DataPacket (arg1 = 0, or -1 on error)
+#define MSG_STATS 10
+
+// Send: DataPacket (arg1 = inum, arg2 = 1 to pin or 0 to unpin)
+// Receive: DataPacket (arg1 = 0, or -1 on error)
+#define MSG_PIN_FILE 11
+
+// Send: DataPacket (arg1 = inum, arg2 = offset, arg3 = len, arg4 = advice)
+// Receive: DataPacket (arg1 = 0, or -1 on error)
+#define MSG_ADVISE 12
+
+// Send: DataPacket (arg1 = sizeof(struct FsFileRuns), pointer = struct FsFileRuns *)
+// Receive: DataPacket (arg1 = 0, or -1 on error)
+#define MSG_FILE_RUNS 13
+
 /*
  * All of the below must have size of 32 bytes.
  */
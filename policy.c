@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "policy.h"
+
+/*********************
+ * Resident Lists *
+ ********************/
+void PushToBlockList(struct block_cache* stack, struct block_cache_entry* entry, int list) {
+    struct block_list* l = &stack->lists[list];
+    entry->list = list;
+    entry->prev_lru = NULL;
+    entry->next_lru = l->top;
+    if (l->top != NULL) l->top->prev_lru = entry;
+    else l->base = entry;
+    l->top = entry;
+    l->size++;
+}
+
+void AppendToBlockList(struct block_cache* stack, struct block_cache_entry* entry, int list) {
+    struct block_list* l = &stack->lists[list];
+    entry->list = list;
+    entry->next_lru = NULL;
+    entry->prev_lru = l->base;
+    if (l->base != NULL) l->base->next_lru = entry;
+    else l->top = entry;
+    l->base = entry;
+    l->size++;
+}
+
+void RemoveFromBlockList(struct block_cache* stack, struct block_cache_entry* entry) {
+    struct block_list* l = &stack->lists[entry->list];
+    if (entry->prev_lru != NULL) entry->prev_lru->next_lru = entry->next_lru;
+    else l->top = entry->next_lru;
+    if (entry->next_lru != NULL) entry->next_lru->prev_lru = entry->prev_lru;
+    else l->base = entry->prev_lru;
+    entry->prev_lru = NULL;
+    entry->next_lru = NULL;
+    l->size--;
+}
+
+/**
+ * Private helper that moves an entry to the top of a list, which may be the
+ * list it is already on
+ */
+void MoveToBlockList(struct block_cache* stack, struct block_cache_entry* entry, int list) {
+    if (entry->list == list && stack->lists[list].top == entry) return;
+    RemoveFromBlockList(stack, entry);
+    PushToBlockList(stack, entry, list);
+}
+
+/**
+ * Private helper that removes the entry to evict from a list. Pinned entries
+ * are skipped. The least recently used clean entry of the older half is
+ * preferred so the miss does not wait on a write, otherwise the oldest
+ * unpinned entry is taken. If every entry of the list is pinned the other
+ * lists are searched, the caller can tell from entry->list where it came from.
+ */
+struct block_cache_entry* PopBlockListVictim(struct block_cache* stack, int list) {
+    struct block_cache_entry* entry;
+    struct block_cache_entry* oldest;
+    int window;
+    int i;
+
+    for (i = 0; i < BLOCK_LISTS; i++, list = (list + 1) % BLOCK_LISTS) {
+        oldest = NULL;
+        window = (stack->lists[list].size + 1) / 2;
+        for (entry = stack->lists[list].base; entry != NULL; entry = entry->prev_lru, window--) {
+            if (entry->pin_count > 0) continue;
+            if (oldest == NULL) oldest = entry;
+            if (window <= 0) break;
+            if (!entry->dirty) {
+                oldest = entry;
+                break;
+            }
+        }
+        if (oldest != NULL) {
+            RemoveFromBlockList(stack, oldest);
+            return oldest;
+        }
+    }
+
+    fprintf(stderr, "Every block in the cache is pinned.\n");
+    exit(1);
+}
+
+/*********************
+ * Ghost Lists *
+ ********************/
+struct ghost_entry* LookUpGhost(struct block_cache* stack, int block_number) {
+    struct ghost_entry* ghost;
+    for (ghost = stack->ghost_hash_set[HashIndex(block_number, stack->hash_size)]; ghost != NULL; ghost = ghost->next_hash) {
+        if (ghost->block_number == block_number) return ghost;
+    }
+    return NULL;
+}
+
+/**
+ * Forgets a ghost and returns it to the free ghosts
+ */
+void RemoveGhost(struct block_cache* stack, struct ghost_entry* ghost) {
+    struct ghost_list* l = &stack->ghosts[ghost->list];
+    if (ghost->prev_lru != NULL) ghost->prev_lru->next_lru = ghost->next_lru;
+    else l->top = ghost->next_lru;
+    if (ghost->next_lru != NULL) ghost->next_lru->prev_lru = ghost->prev_lru;
+    else l->base = ghost->prev_lru;
+    l->size--;
+
+    if (ghost->prev_hash != NULL) ghost->prev_hash->next_hash = ghost->next_hash;
+    else stack->ghost_hash_set[HashIndex(ghost->block_number, stack->hash_size)] = ghost->next_hash;
+    if (ghost->next_hash != NULL) ghost->next_hash->prev_hash = ghost->prev_hash;
+
+    ghost->next_lru = stack->ghost_free;
+    stack->ghost_free = ghost;
+}
+
+/**
+ * Drops the oldest ghosts of a list until it holds at most max_size
+ */
+void TrimGhosts(struct block_cache* stack, int list, int max_size) {
+    while (stack->ghosts[list].size > max_size) {
+        RemoveGhost(stack, stack->ghosts[list].base);
+    }
+}
+
+/**
+ * Remembers an evicted block number at the top of a ghost list
+ */
+void AddGhost(struct block_cache* stack, int block_number, int list) {
+    struct ghost_entry* ghost;
+    int index;
+    if (block_number <= 0) return;
+
+    /** Policies trim their ghosts, this only guards the fixed pool */
+    if (stack->ghost_free == NULL) {
+        if (stack->ghosts[GHOST_RECENT].size >= stack->ghosts[GHOST_FREQUENT].size) {
+            RemoveGhost(stack, stack->ghosts[GHOST_RECENT].base);
+        } else {
+            RemoveGhost(stack, stack->ghosts[GHOST_FREQUENT].base);
+        }
+    }
+    ghost = stack->ghost_free;
+    stack->ghost_free = ghost->next_lru;
+
+    ghost->block_number = block_number;
+    ghost->list = list;
+    ghost->prev_lru = NULL;
+    ghost->next_lru = stack->ghosts[list].top;
+    if (stack->ghosts[list].top != NULL) stack->ghosts[list].top->prev_lru = ghost;
+    else stack->ghosts[list].base = ghost;
+    stack->ghosts[list].top = ghost;
+    stack->ghosts[list].size++;
+
+    index = HashIndex(block_number, stack->hash_size);
+    ghost->prev_hash = NULL;
+    ghost->next_hash = stack->ghost_hash_set[index];
+    if (ghost->next_hash != NULL) ghost->next_hash->prev_hash = ghost;
+    stack->ghost_hash_set[index] = ghost;
+}
+
+/*********************
+ * LRU *
+ ********************/
+void LRUHit(struct block_cache* stack, struct block_cache_entry* entry) {
+    MoveToBlockList(stack, entry, LIST_RECENT);
+}
+
+int LRUMiss(struct block_cache* stack, int block_number) {
+    (void)stack;
+    (void)block_number;
+    return LIST_RECENT;
+}
+
+struct block_cache_entry* LRUVictim(struct block_cache* stack, int list) {
+    (void)list;
+    return PopBlockListVictim(stack, LIST_RECENT);
+}
+
+/*********************
+ * 2Q *
+ ********************/
+/**
+ * New blocks enter A1in, a FIFO of about a quarter of the cache. Only blocks
+ * referenced again after falling out of A1in (found in the A1out ghosts)
+ * are promoted to Am, so one pass over a large file cannot flush Am.
+ */
+void TwoQueueHit(struct block_cache* stack, struct block_cache_entry* entry) {
+    if (entry->list == LIST_FREQUENT) MoveToBlockList(stack, entry, LIST_FREQUENT);
+}
+
+int TwoQueueMiss(struct block_cache* stack, int block_number) {
+    struct ghost_entry* ghost = LookUpGhost(stack, block_number);
+    if (ghost == NULL) return LIST_RECENT;
+    RemoveGhost(stack, ghost);
+    return LIST_FREQUENT;
+}
+
+struct block_cache_entry* TwoQueueVictim(struct block_cache* stack, int list) {
+    struct block_cache_entry* entry;
+    int max_recent = stack->capacity / 4;
+    int max_ghosts = stack->capacity / 2;
+    (void)list;
+    if (max_recent < 1) max_recent = 1;
+    if (max_ghosts < 1) max_ghosts = 1;
+
+    if (stack->lists[LIST_RECENT].size > max_recent || stack->lists[LIST_FREQUENT].size == 0) {
+        entry = PopBlockListVictim(stack, LIST_RECENT);
+    } else {
+        entry = PopBlockListVictim(stack, LIST_FREQUENT);
+    }
+    if (entry->list == LIST_RECENT) {
+        AddGhost(stack, entry->block_number, GHOST_RECENT);
+        TrimGhosts(stack, GHOST_RECENT, max_ghosts);
+    }
+    return entry;
+}
+
+/*********************
+ * ARC *
+ ********************/
+/**
+ * Adaptive Replacement Cache (Megiddo and Modha). T1 holds blocks seen once,
+ * T2 blocks seen at least twice, and B1/B2 remember what each evicted. A hit
+ * in B1 grows the target size of T1, a hit in B2 shrinks it.
+ */
+void ARCHit(struct block_cache* stack, struct block_cache_entry* entry) {
+    MoveToBlockList(stack, entry, LIST_FREQUENT);
+}
+
+int ARCMiss(struct block_cache* stack, int block_number) {
+    struct ghost_entry* ghost = LookUpGhost(stack, block_number);
+    int recent = stack->lists[LIST_RECENT].size;
+    int frequent = stack->lists[LIST_FREQUENT].size;
+    int recent_ghosts = stack->ghosts[GHOST_RECENT].size;
+    int frequent_ghosts = stack->ghosts[GHOST_FREQUENT].size;
+    int delta;
+
+    stack->ghost_hit_frequent = 0;
+    stack->evict_without_ghost = 0;
+
+    if (ghost != NULL && ghost->list == GHOST_RECENT) {
+        delta = frequent_ghosts > recent_ghosts ? frequent_ghosts / recent_ghosts : 1;
+        stack->target_recent += delta;
+        if (stack->target_recent > stack->capacity) stack->target_recent = stack->capacity;
+        RemoveGhost(stack, ghost);
+        return LIST_FREQUENT;
+    }
+
+    if (ghost != NULL) {
+        delta = recent_ghosts > frequent_ghosts ? recent_ghosts / frequent_ghosts : 1;
+        stack->target_recent -= delta;
+        if (stack->target_recent < 0) stack->target_recent = 0;
+        stack->ghost_hit_frequent = 1;
+        RemoveGhost(stack, ghost);
+        return LIST_FREQUENT;
+    }
+
+    /** Complete miss, keep |T1| + |B1| <= c and the whole directory <= 2c */
+    if (recent + recent_ghosts >= stack->capacity) {
+        if (recent < stack->capacity) TrimGhosts(stack, GHOST_RECENT, recent_ghosts - 1);
+        else stack->evict_without_ghost = 1;
+    } else if (recent + frequent + recent_ghosts + frequent_ghosts >= 2 * stack->capacity) {
+        TrimGhosts(stack, GHOST_FREQUENT, frequent_ghosts - 1);
+    }
+    return LIST_RECENT;
+}
+
+struct block_cache_entry* ARCVictim(struct block_cache* stack, int list) {
+    struct block_cache_entry* entry;
+    int recent = stack->lists[LIST_RECENT].size;
+    (void)list;
+
+    if (stack->evict_without_ghost) {
+        stack->evict_without_ghost = 0;
+        return PopBlockListVictim(stack, LIST_RECENT);
+    }
+
+    if (recent > 0 && (recent > stack->target_recent ||
+                       (stack->ghost_hit_frequent && recent == stack->target_recent) ||
+                       stack->lists[LIST_FREQUENT].size == 0)) {
+        entry = PopBlockListVictim(stack, LIST_RECENT);
+    } else {
+        entry = PopBlockListVictim(stack, LIST_FREQUENT);
+    }
+    AddGhost(stack, entry->block_number, entry->list == LIST_RECENT ? GHOST_RECENT : GHOST_FREQUENT);
+    return entry;
+}
+
+/*********************
+ * Policy Table *
+ ********************/
+struct replacement_policy replacement_policies[] = {
+    {"lru", LRUHit, LRUMiss, LRUVictim},
+    {"2q", TwoQueueHit, TwoQueueMiss, TwoQueueVictim},
+    {"arc", ARCHit, ARCMiss, ARCVictim},
+};
+
+struct replacement_policy* GetReplacementPolicy(char* name) {
+    unsigned int i;
+    for (i = 0; i < sizeof(replacement_policies) / sizeof(replacement_policies[0]); i++) {
+        if (strcmp(replacement_policies[i].name, name) == 0) return &replacement_policies[i];
+    }
+    return NULL;
+}
+
+void InitReplacementPolicy(struct block_cache* stack, struct replacement_policy* policy) {
+    int i;
+    stack->policy = policy;
+    stack->target_recent = 0;
+    stack->ghost_hit_frequent = 0;
+    stack->evict_without_ghost = 0;
+    for (i = 0; i < BLOCK_LISTS; i++) {
+        stack->lists[i].top = NULL;
+        stack->lists[i].base = NULL;
+        stack->lists[i].size = 0;
+        stack->ghosts[i].top = NULL;
+        stack->ghosts[i].base = NULL;
+        stack->ghosts[i].size = 0;
+    }
+
+    /** One ghost per cache slot covers both 2Q's A1out and ARC's B1 + B2 */
+    stack->ghost_pool = calloc(stack->capacity, sizeof(struct ghost_entry));
+    stack->ghost_hash_set = calloc(stack->hash_size, sizeof(struct ghost_entry*));
+    stack->ghost_free = NULL;
+    for (i = 0; i < stack->capacity; i++) {
+        stack->ghost_pool[i].next_lru = stack->ghost_free;
+        stack->ghost_free = &stack->ghost_pool[i];
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef COMP421_LAB3_POLICY_H
+#define COMP421_LAB3_POLICY_H
+
+#include "cache.h"
+
+/**
+ * Resident lists of the block cache. What they mean depends on the policy:
+ * LRU only uses LIST_RECENT, 2Q uses them as A1in and Am, ARC as T1 and T2.
+ */
+#define LIST_RECENT     0
+#define LIST_FREQUENT   1
+
+/**
+ * Ghost lists remember numbers of evicted blocks, 2Q uses GHOST_RECENT as
+ * A1out, ARC uses them as B1 and B2. LRU keeps no ghosts.
+ */
+#define GHOST_RECENT    0
+#define GHOST_FREQUENT  1
+
+/**
+ * A block replacement policy, chosen once when the cache is created.
+ */
+struct replacement_policy {
+    char* name;
+    /**
+     * Called when a lookup finds entry in the cache
+     */
+    void (*hit)(struct block_cache* stack, struct block_cache_entry* entry);
+    /**
+     * Called when block_number is about to be added to the cache. Consumes
+     * any ghost of the block and adapts the policy.
+     * @return The resident list the block will be placed in
+     */
+    int (*miss)(struct block_cache* stack, int block_number);
+    /**
+     * Called when the cache is full to choose the entry to evict. The entry
+     * is removed from its list and remembered in a ghost list if needed.
+     * @param list List the incoming block will be placed in
+     */
+    struct block_cache_entry* (*victim)(struct block_cache* stack, int list);
+};
+
+/**
+ * Finds a policy by name ("lru", "2q" or "arc")
+ * @return The policy, or NULL if the name is unknown
+ */
+struct replacement_policy* GetReplacementPolicy(char* name);
+
+/**
+ * Sets up the ghost lists and policy state of a newly created cache
+ */
+void InitReplacementPolicy(struct block_cache* stack, struct replacement_policy* policy);
+
+/**
+ * Places an entry at the top of one of the cache's resident lists
+ */
+void PushToBlockList(struct block_cache* stack, struct block_cache_entry* entry, int list);
+
+/**
+ * Places an entry at the base of one of the cache's resident lists, where
+ * it is the first candidate for eviction
+ */
+void AppendToBlockList(struct block_cache* stack, struct block_cache_entry* entry, int list);
+
+/**
+ * Unlinks an entry from the resident list it is on
+ */
+void RemoveFromBlockList(struct block_cache* stack, struct block_cache_entry* entry);
+
+#endif //COMP421_LAB3_POLICY_H
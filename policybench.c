@@ -0,0 +1,126 @@
+/*
+ *  Host-side benchmark for the block cache replacement policies.
+ *
+ *  This is a Unix program (not a Yalnix program).  It links the real
+ *  cache.c and policy.c, with ReadSector and WriteSector replaced by
+ *  counters, and replays a trace in which a small hot set of metadata
+ *  blocks (inode and directory blocks) is touched between the blocks of
+ *  a large file being read front to back.  For each policy it reports the
+ *  hit rate on the metadata blocks and the total number of disk reads, once
+ *  with every block in one partition and once with the metadata blocks
+ *  tagged BLOCK_METADATA and given a quarter of the capacity.
+ *
+ *  Usage: policybench [capacity] [hot_blocks] [scan_blocks]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <comp421/filesystem.h>
+#include "cache.h"
+#include "policy.h"
+
+#define DEFAULT_HOT         6
+#define DEFAULT_SCAN        1000
+#define SCAN_PASSES         3
+#define SCAN_PER_HOT        8 /* File blocks read between two metadata lookups */
+
+extern struct block_cache* block_stacks[BLOCK_CLASSES];
+
+long sector_reads;
+long sector_writes;
+
+int ReadSector(int sectornum, void *buf) {
+    (void)sectornum;
+    (void)buf;
+    sector_reads++;
+    return 0;
+}
+
+int WriteSector(int sectornum, void *buf) {
+    (void)sectornum;
+    (void)buf;
+    sector_writes++;
+    return 0;
+}
+
+struct bench_result {
+    long hot_lookups;
+    long hot_hits;
+    long reads;
+};
+
+/**
+ * Looks up a block through GetBlock, counting it as a hit if it was resident
+ */
+int TouchBlock(int block_num, int block_class) {
+    int hits = block_stacks[BLOCK_METADATA]->hits + block_stacks[BLOCK_DATA]->hits;
+    GetBlock(block_num, block_class);
+    return block_stacks[BLOCK_METADATA]->hits + block_stacks[BLOCK_DATA]->hits > hits;
+}
+
+/**
+ * Replays the trace once against a fresh cache.  Hot blocks live right after
+ * the inode blocks, the file being scanned lives after them.  Unless split,
+ * everything is tagged BLOCK_DATA and the metadata partition stays empty.
+ */
+struct bench_result RunPolicy(char *name, int capacity, int hot, int scan, int split) {
+    int hot_class = split ? BLOCK_METADATA : BLOCK_DATA;
+    struct bench_result result;
+    int first_hot = 1;
+    int first_scan = first_hot + hot;
+    int next_hot = 0;
+    int pass;
+    int i;
+
+    CreateBlockCache(NUMBLOCKS, split ? capacity / 4 : 4, GetReplacementPolicy(name), BLOCK_METADATA);
+    CreateBlockCache(NUMBLOCKS, split ? capacity - capacity / 4 : capacity, GetReplacementPolicy(name), BLOCK_DATA);
+    sector_reads = 0;
+    result.hot_lookups = 0;
+    result.hot_hits = 0;
+
+    /* Warm up the metadata the way a path lookup would */
+    for (i = 0; i < hot; i++) TouchBlock(first_hot + i, hot_class);
+    for (i = 0; i < hot; i++) TouchBlock(first_hot + i, hot_class);
+
+    for (pass = 0; pass < SCAN_PASSES; pass++) {
+        for (i = 0; i < scan; i++) {
+            TouchBlock(first_scan + i, BLOCK_DATA);
+            if (i % SCAN_PER_HOT == 0) {
+                result.hot_lookups++;
+                result.hot_hits += TouchBlock(first_hot + next_hot, hot_class);
+                next_hot = (next_hot + 1) % hot;
+            }
+        }
+    }
+
+    result.reads = sector_reads;
+    return result;
+}
+
+void PrintResult(char *name, char *layout, struct bench_result result) {
+    printf("%-8s %-8s %12.1f%% %12ld\n", name, layout, 100.0 * result.hot_hits / result.hot_lookups, result.reads);
+}
+
+int main(int argc, char **argv) {
+    int capacity = BLOCK_CACHESIZE;
+    int hot = DEFAULT_HOT;
+    int scan = DEFAULT_SCAN;
+    char *policies[] = {"lru", "2q", "arc"};
+    int i;
+
+    if ((argc > 1 && sscanf(argv[1], "%d", &capacity) != 1) ||
+        (argc > 2 && sscanf(argv[2], "%d", &hot) != 1) ||
+        (argc > 3 && sscanf(argv[3], "%d", &scan) != 1) ||
+        capacity < 16 || hot < 1 || scan < 1 || 1 + hot + scan >= NUMBLOCKS) {
+        fprintf(stderr, "usage: policybench [capacity] [hot_blocks] [scan_blocks]\n");
+        exit(1);
+    }
+
+    printf("capacity %d, %d hot blocks, %d passes over %d file blocks\n", capacity, hot, SCAN_PASSES, scan);
+    printf("%-8s %-8s %13s %12s\n", "policy", "layout", "hot hit rate", "disk reads");
+    for (i = 0; i < 3; i++) {
+        PrintResult(policies[i], "shared", RunPolicy(policies[i], capacity, hot, scan, 0));
+        PrintResult(policies[i], "split", RunPolicy(policies[i], capacity, hot, scan, 1));
+    }
+    exit(0);
+}
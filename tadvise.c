@@ -0,0 +1,75 @@
+/*
+ * Checks that Advise is honoured. A small hot file must survive a large
+ * file streamed with ADVISE_SEQUENTIAL, and a range given ADVISE_WILLNEED
+ * must be cached by the time it is read.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+#include "cachectl.h"
+#include "testblocks.h"
+
+#define HOT_BLOCKS      4
+#define STREAM_BLOCKS   60
+#define NEED_BLOCKS     8
+
+/*
+ * Reads a whole file after giving advice, and checks its contents
+ */
+void
+ReadAdvised(char *pathname, int blocks, int advice, char ch)
+{
+    int fd = Open(pathname);
+
+    Check(Advise(fd, 0, 0, advice) == 0 && ReadBlocks(fd, blocks, 1, ch) == 0, pathname);
+    Close(fd);
+}
+
+int
+SectorReads()
+{
+    struct FsStats stats;
+    GetFsStats(&stats);
+    return stats.sector_reads;
+}
+
+int
+main()
+{
+    int reads;
+    int fd;
+
+    WriteBlocks("/hot", HOT_BLOCKS, 'h');
+    WriteBlocks("/stream", STREAM_BLOCKS, 's');
+    WriteBlocks("/need", NEED_BLOCKS, 'n');
+    Sync();
+
+    ReadAdvised("/hot", HOT_BLOCKS, ADVISE_NORMAL, 'h');
+    ReadAdvised("/stream", STREAM_BLOCKS, ADVISE_SEQUENTIAL, 's');
+    reads = SectorReads();
+    ReadAdvised("/hot", HOT_BLOCKS, ADVISE_NORMAL, 'h');
+    reads = SectorReads() - reads;
+    printf("Sector reads for the hot file after the stream: %d\n", reads);
+    Check(reads == 0, "Hot file survives a SEQUENTIAL stream");
+
+    /* Streaming without advice pushes everything else out */
+    ReadAdvised("/stream", STREAM_BLOCKS, ADVISE_NORMAL, 's');
+    fd = Open("/need");
+    Check(Advise(fd, 0, 0, ADVISE_WILLNEED) == 0, "WILLNEED");
+    /* Any request lets the server run the prefetch after replying */
+    SectorReads();
+    reads = SectorReads();
+    Check(ReadBlocks(fd, NEED_BLOCKS, 1, 'n') == 0, "/need");
+    reads = SectorReads() - reads;
+    printf("Sector reads for the WILLNEED range: %d\n", reads);
+    Check(reads == 0, "WILLNEED range prefetched");
+    Close(fd);
+
+    Shutdown();
+    return check_failures;
+}
@@ -0,0 +1,72 @@
+/*
+ * Helpers shared by the cache test programs, see testblocks.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "testblocks.h"
+
+int check_failures = 0;
+
+static char block[BLOCKSIZE];
+
+int
+WriteBlocks(char *pathname, int blocks, char ch)
+{
+    int fd = Create(pathname);
+    int result = 0;
+    int i;
+
+    if (fd < 0)
+	return -1;
+    memset(block, ch, sizeof(block));
+    for (i = 0; i < blocks; i++) {
+	if (Write(fd, block, sizeof(block)) != sizeof(block))
+	    result = -1;
+    }
+    Close(fd);
+    return result;
+}
+
+int
+ReadBlocks(int fd, int blocks, int stride, char ch)
+{
+    int bad = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < blocks; i++) {
+	Seek(fd, (i * stride % blocks) * BLOCKSIZE, SEEK_SET);
+	if (Read(fd, block, sizeof(block)) != sizeof(block)) {
+	    bad += BLOCKSIZE;
+	    continue;
+	}
+	for (j = 0; j < BLOCKSIZE; j++)
+	    if (block[j] != ch) bad++;
+    }
+    return bad;
+}
+
+int
+CheckBlocks(char *pathname, int blocks, char ch)
+{
+    int fd = Open(pathname);
+    int bad;
+
+    if (fd < 0)
+	return blocks * BLOCKSIZE;
+    bad = ReadBlocks(fd, blocks, 1, ch);
+    Close(fd);
+    return bad;
+}
+
+void
+Check(int ok, char *what)
+{
+    printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) check_failures++;
+}
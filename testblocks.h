@@ -0,0 +1,37 @@
+#ifndef COMP421_LAB3_TESTBLOCKS_H
+#define COMP421_LAB3_TESTBLOCKS_H
+
+/*
+ * Helpers shared by the cache test programs, which write files in whole
+ * blocks of one character and read them back.
+ */
+
+/*
+ * Create pathname and write blocks whole blocks filled with ch, one block
+ * per Write. Return 0, or -1 if a Write comes up short.
+ */
+int WriteBlocks(char *pathname, int blocks, char ch);
+
+/*
+ * Read blocks whole blocks from the file open as fd, block i * stride
+ * modulo blocks on the i-th read, so stride 1 reads the file in order.
+ * Return the number of bytes that are not ch, counting a short read as a
+ * whole block of them.
+ */
+int ReadBlocks(int fd, int blocks, int stride, char ch);
+
+/*
+ * Open pathname, read its first blocks blocks in order and close it.
+ * Return the number of bytes that are not ch, as ReadBlocks does.
+ */
+int CheckBlocks(char *pathname, int blocks, char ch);
+
+/*
+ * Print what and whether ok holds. Failed checks are counted in
+ * check_failures, which a test returns as its exit status.
+ */
+void Check(int ok, char *what);
+
+extern int check_failures;
+
+#endif //COMP421_LAB3_TESTBLOCKS_H
@@ -0,0 +1,81 @@
+/*
+ * Checks that files stay contiguous on an aged disk. Small files are
+ * written and every other one deleted, leaving short gaps between the
+ * rest. Files written next should fill the gaps that fit them and the
+ * large runs of free blocks should go to large files, so a file keeps
+ * close to one run of blocks.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+#include "testblocks.h"
+
+#define SMALL_FILES     40
+#define SMALL_BLOCKS    3
+#define LARGE_FILES     4
+#define LARGE_BLOCKS    30
+#define MAX_RUNS_TENTHS 15  /* Most runs per file, in tenths, once the large files are written */
+
+/*
+ * Prints how many runs of blocks the files on the disk occupy and returns
+ * the counts
+ */
+struct FsFileRuns
+PrintRuns(char *what)
+{
+    struct FsStats stats;
+    struct FsFileRuns runs;
+    GetFsStats(&stats);
+    GetFsFileRuns(&runs);
+    printf("%s: %d files, %d blocks in %d runs, %.2f runs per file, free blocks %d in %d runs\n", what,
+	runs.files, runs.file_blocks, runs.file_runs,
+	runs.files > 0 ? (double)runs.file_runs / runs.files : 0.0,
+	stats.free_blocks, stats.free_extents);
+    return runs;
+}
+
+int
+main()
+{
+    struct FsFileRuns runs;
+    char name[32];
+    int bad = 0;
+    int i;
+
+    for (i = 0; i < SMALL_FILES; i++) {
+	sprintf(name, "/small%d", i);
+	WriteBlocks(name, SMALL_BLOCKS, 's');
+    }
+    for (i = 0; i < SMALL_FILES; i += 2) {
+	sprintf(name, "/small%d", i);
+	Unlink(name);
+    }
+    Sync();
+    runs = PrintRuns("After deleting every other small file");
+    Check(runs.file_runs == runs.files, "Each small file is one run");
+
+    for (i = 0; i < LARGE_FILES; i++) {
+	sprintf(name, "/large%d", i);
+	WriteBlocks(name, LARGE_BLOCKS, 'a' + i);
+    }
+    for (i = 0; i < SMALL_FILES / 2; i++) {
+	sprintf(name, "/refill%d", i);
+	WriteBlocks(name, SMALL_BLOCKS, 'r');
+    }
+    runs = PrintRuns("After writing large files and refilling");
+    Check(runs.file_runs * 10 <= runs.files * MAX_RUNS_TENTHS, "Files stay close to one run");
+
+    for (i = 0; i < LARGE_FILES; i++) {
+	sprintf(name, "/large%d", i);
+	bad += CheckBlocks(name, LARGE_BLOCKS, 'a' + i);
+    }
+    Check(bad == 0, "Read back large files");
+
+    Shutdown();
+    return check_failures;
+}
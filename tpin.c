@@ -0,0 +1,50 @@
+/*
+ * Pins a small file, streams a file much larger than the block cache past
+ * it, and checks that reading the pinned file back takes no sector reads.
+ * Run the server with space reserved for pinned files, e.g. yfs -r 16 tpin
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+#include "cachectl.h"
+#include "testblocks.h"
+
+#define PINNED_BLOCKS   6
+#define STREAM_BLOCKS   80
+
+int
+main()
+{
+    struct FsStats before;
+    struct FsStats after;
+
+    Check(WriteBlocks("/pinned", PINNED_BLOCKS, 'p') == 0, "Write pinned");
+    Check(PinFile("/pinned") == 0, "PinFile");
+
+    Check(WriteBlocks("/stream", STREAM_BLOCKS, 's') == 0, "Write stream");
+    Check(CheckBlocks("/stream", STREAM_BLOCKS, 's') == 0, "Read stream");
+
+    GetFsStats(&before);
+    Check(CheckBlocks("/pinned", PINNED_BLOCKS, 'p') == 0, "Read pinned");
+    GetFsStats(&after);
+    printf("Sector reads while reading the pinned file: %d\n", after.sector_reads - before.sector_reads);
+    Check(after.sector_reads == before.sector_reads, "Pinned file read from the cache");
+
+    /* The data blocks and the inode block, the file has no indirect block */
+    printf("Pinned blocks %d, pinned files %d\n",
+	after.caches[FS_STATS_PINNED_BLOCKS].size, after.pinned_files);
+    Check(after.caches[FS_STATS_PINNED_BLOCKS].size == PINNED_BLOCKS + 1 && after.pinned_files == 1,
+	"Pinned block count");
+
+    Check(UnpinFile("/pinned") == 0, "UnpinFile");
+    GetFsStats(&after);
+    Check(after.caches[FS_STATS_PINNED_BLOCKS].size == 0 && after.pinned_files == 0, "Nothing pinned after unpin");
+
+    Shutdown();
+    return check_failures;
+}
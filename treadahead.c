@@ -0,0 +1,77 @@
+/*
+ * Checks sequential readahead. Reading a file front to back should have the
+ * server prefetch the blocks ahead of the reader, reads that jump around or
+ * a file advised ADVISE_RANDOM should prefetch nothing.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+#include "cachectl.h"
+#include "testblocks.h"
+
+#define FILE_BLOCKS     40
+#define FIRST_WINDOW    2   /* Blocks read ahead of the first read of a file */
+
+/*
+ * Reads a file's blocks in order, or every seventh block when stride is 7,
+ * after giving advice unless it is -1, and checks their contents
+ */
+void
+ReadStrided(char *pathname, int advice, int stride, char ch)
+{
+    int fd = Open(pathname);
+
+    if (advice >= 0) Advise(fd, 0, 0, advice);
+    Check(ReadBlocks(fd, FILE_BLOCKS, stride, ch) == 0, pathname);
+    Close(fd);
+}
+
+/*
+ * Prints the prefetches since before and stores their counts in
+ * prefetched and used
+ */
+void
+CountPrefetches(char *what, struct FsStats *before, int *prefetched, int *used)
+{
+    struct FsStats stats;
+    GetFsStats(&stats);
+    *prefetched = stats.prefetched - before->prefetched;
+    *used = stats.prefetch_hits - before->prefetch_hits;
+    printf("%s: %d prefetched, %d used\n", what, *prefetched, *used);
+    *before = stats;
+}
+
+int
+main()
+{
+    struct FsStats stats;
+    int prefetched;
+    int used;
+
+    WriteBlocks("/a", FILE_BLOCKS, 'a');
+    WriteBlocks("/b", FILE_BLOCKS, 'b');
+    Sync();
+    GetFsStats(&stats);
+
+    /* /b pushed /a out of the cache */
+    ReadStrided("/a", -1, 1, 'a');
+    CountPrefetches("Sequential read", &stats, &prefetched, &used);
+    Check(prefetched > 0 && used == prefetched, "Sequential read uses every prefetch");
+
+    /* Only the first read looks like the start of a stream */
+    ReadStrided("/b", -1, 7, 'b');
+    CountPrefetches("Strided read", &stats, &prefetched, &used);
+    Check(prefetched <= FIRST_WINDOW, "Strided read prefetches no more than the first window");
+
+    ReadStrided("/a", ADVISE_RANDOM, 1, 'a');
+    CountPrefetches("Sequential read advised RANDOM", &stats, &prefetched, &used);
+    Check(prefetched == 0, "RANDOM advice turns readahead off");
+
+    Shutdown();
+    return check_failures;
+}
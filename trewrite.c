@@ -0,0 +1,79 @@
+/*
+ * Rewrites a file much larger than the block cache in whole blocks.
+ *
+ * The first pass pushes the early blocks out of the cache, so the second
+ * pass overwrites blocks that are no longer cached.  Whole block overwrites
+ * are installed without reading the old sector: the data partition's
+ * misses, from GetFsStats, stay the same across the second pass while its
+ * installs grow by the size of the file.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+#include "testblocks.h"
+
+#define REWRITE_BLOCKS  64
+#define CHUNK_BLOCKS    4
+
+char buf[CHUNK_BLOCKS * BLOCKSIZE];
+
+/*
+ * Writes the whole file in CHUNK_BLOCKS sized writes filled with ch
+ */
+int
+WritePass(int fd, char ch)
+{
+    int i;
+
+    Seek(fd, 0, SEEK_SET);
+    memset(buf, ch, sizeof(buf));
+    for (i = 0; i < REWRITE_BLOCKS / CHUNK_BLOCKS; i++) {
+	if (Write(fd, buf, sizeof(buf)) != sizeof(buf))
+	    return -1;
+    }
+    return 0;
+}
+
+/*
+ * Prints the data partition's misses and installs so far and returns them
+ */
+struct FsCacheStats
+DataCounts(char *what)
+{
+    struct FsStats stats;
+
+    GetFsStats(&stats);
+    printf("%s: data misses %d installs %d\n", what,
+	stats.caches[FS_STATS_DATA_BLOCKS].misses, stats.caches[FS_STATS_DATA_BLOCKS].installs);
+    return stats.caches[FS_STATS_DATA_BLOCKS];
+}
+
+int
+main()
+{
+    struct FsCacheStats first;
+    struct FsCacheStats second;
+    int fd;
+
+    fd = Create("/rewrite");
+    Check(fd >= 0, "Create");
+
+    Check(WritePass(fd, 'a') == 0, "First pass");
+    first = DataCounts("After first pass");
+    Check(WritePass(fd, 'b') == 0, "Second pass");
+    second = DataCounts("After second pass");
+    Check(second.misses == first.misses, "Second pass reads no old blocks");
+    Check(second.installs - first.installs == REWRITE_BLOCKS, "Second pass installs the blocks it overwrites");
+
+    Check(ReadBlocks(fd, REWRITE_BLOCKS, 1, 'b') == 0, "Read back");
+    DataCounts("After read back");
+
+    Close(fd);
+    Shutdown();
+    return check_failures;
+}
@@ -0,0 +1,217 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <comp421/filesystem.h>
+#include "hash.h"
+#include "victim.h"
+
+#define RUN_MIN 3 //Shortest run of equal bytes worth a run token
+#define RUN_MAX 130 //Longest run one run token covers
+#define LITERAL_MAX 128 //Most bytes one literal token covers
+#define ENTRY_ALIGN (int)sizeof(struct victim_entry*) //Entries start at multiples of this in the arena
+
+struct victim_cache* victim_cache;
+
+struct victim_cache* CreateVictimCache(int budget) {
+    struct victim_cache* vc = calloc(1, sizeof(struct victim_cache));
+    vc->budget = budget - budget % ENTRY_ALIGN;
+    vc->arena = malloc(vc->budget);
+    vc->hash_size = GetHashSize(budget / VICTIM_ENTRY_BYTES + 1);
+    vc->hash_set = calloc(vc->hash_size, sizeof(struct victim_entry*));
+    vc->scratch = malloc(BLOCKSIZE);
+    vc->taken = malloc(BLOCKSIZE);
+    victim_cache = vc;
+    return vc;
+}
+
+/**
+ * Private helper that run length encodes a block into out. A token byte
+ * below 128 is followed by that many plus one literal bytes, a token of 128
+ * or more is followed by one byte repeated token - 128 + RUN_MIN times.
+ * @param max Most bytes out may take
+ * @return Compressed size, or -1 if it would exceed max
+ */
+int CompressBlock(unsigned char* in, unsigned char* out, int max) {
+    int size = 0;
+    int literal = -1; //Index in out of the open literal token
+    int i = 0;
+    int run;
+
+    while (i < BLOCKSIZE) {
+        for (run = 1; i + run < BLOCKSIZE && run < RUN_MAX && in[i + run] == in[i]; run++);
+        if (run >= RUN_MIN) {
+            if (size + 2 > max) return -1;
+            out[size++] = 128 + run - RUN_MIN;
+            out[size++] = in[i];
+            literal = -1;
+            i += run;
+            continue;
+        }
+        if (literal < 0 || out[literal] == LITERAL_MAX - 1) {
+            if (size + 1 > max) return -1;
+            literal = size;
+            out[size++] = 0;
+        } else {
+            out[literal]++;
+        }
+        if (size + 1 > max) return -1;
+        out[size++] = in[i++];
+    }
+    return size;
+}
+
+/**
+ * Private helper that expands a block compressed by CompressBlock
+ */
+void DecompressBlock(unsigned char* in, int size, unsigned char* out) {
+    int i = 0;
+    int count;
+
+    while (i < size) {
+        if (in[i] >= 128) {
+            count = in[i] - 128 + RUN_MIN;
+            memset(out, in[i + 1], count);
+            i += 2;
+        } else {
+            count = in[i] + 1;
+            memcpy(out, in + i + 1, count);
+            i += count + 1;
+        }
+        out += count;
+    }
+}
+
+/**
+ * Private helper that gives the arena bytes an entry of size data bytes takes
+ */
+int EntryBytes(int size) {
+    int bytes = offsetof(struct victim_entry, data) + size;
+    return (bytes + ENTRY_ALIGN - 1) / ENTRY_ALIGN * ENTRY_ALIGN;
+}
+
+/**
+ * Private helper that turns an entry into a hole, its space stays in use
+ * until the tail reaches it
+ */
+void RemoveVictim(struct victim_cache* vc, struct victim_entry* entry) {
+    if (entry->prev_hash != NULL) entry->prev_hash->next_hash = entry->next_hash;
+    else vc->hash_set[HashIndex(entry->block_number, vc->hash_size)] = entry->next_hash;
+    if (entry->next_hash != NULL) entry->next_hash->prev_hash = entry->prev_hash;
+
+    entry->block_number = VICTIM_HOLE;
+    vc->used -= entry->size;
+    vc->blocks--;
+}
+
+/**
+ * Private helper that frees the entry at the tail, dropping its block if it
+ * still holds one
+ */
+void DropOldestVictim(struct victim_cache* vc) {
+    struct victim_entry* entry = (struct victim_entry*)(vc->arena + vc->tail);
+    if (entry->block_number != VICTIM_HOLE) RemoveVictim(vc, entry);
+
+    vc->tail += EntryBytes(entry->size);
+    vc->entries--;
+    if (vc->wrapped && vc->tail == vc->lap_end) {
+        vc->tail = 0;
+        vc->wrapped = 0;
+    }
+    if (vc->entries == 0) {
+        vc->head = 0;
+        vc->tail = 0;
+        vc->wrapped = 0;
+    }
+}
+
+/**
+ * Private helper that frees holes at the tail, so space given back in the
+ * order it was written is reusable at once
+ */
+void TrimHoles(struct victim_cache* vc) {
+    while (vc->entries > 0 && ((struct victim_entry*)(vc->arena + vc->tail))->block_number == VICTIM_HOLE) {
+        DropOldestVictim(vc);
+    }
+}
+
+/**
+ * Private helper that finds a block's entry
+ */
+struct victim_entry* LookUpVictim(struct victim_cache* vc, int block_number) {
+    struct victim_entry* entry;
+    for (entry = vc->hash_set[HashIndex(block_number, vc->hash_size)]; entry != NULL; entry = entry->next_hash) {
+        if (entry->block_number == block_number) return entry;
+    }
+    return NULL;
+}
+
+void AddVictim(struct victim_cache* vc, int block_number, void* block) {
+    struct victim_entry* entry;
+    int index = HashIndex(block_number, vc->hash_size);
+    int size = CompressBlock(block, vc->scratch, BLOCKSIZE * VICTIM_MAX_PERCENT / 100);
+    int bytes = EntryBytes(size);
+
+    if (size < 0 || bytes > vc->budget) {
+        vc->rejected++;
+        return;
+    }
+    vc->admitted++;
+    vc->admitted_bytes += size;
+
+    /** Find bytes free bytes at the head, wrapping to the start of the arena if the end is too short */
+    while (1) {
+        if (!vc->wrapped) {
+            if (vc->budget - vc->head >= bytes) break;
+            vc->lap_end = vc->head;
+            vc->head = 0;
+            vc->wrapped = 1;
+        }
+        if (vc->tail - vc->head >= bytes) break;
+        DropOldestVictim(vc);
+    }
+
+    entry = (struct victim_entry*)(vc->arena + vc->head);
+    vc->head += bytes;
+    vc->entries++;
+    entry->block_number = block_number;
+    entry->size = size;
+    memcpy(entry->data, vc->scratch, size);
+
+    entry->prev_hash = NULL;
+    entry->next_hash = vc->hash_set[index];
+    if (entry->next_hash != NULL) entry->next_hash->prev_hash = entry;
+    vc->hash_set[index] = entry;
+
+    vc->used += size;
+    vc->blocks++;
+}
+
+void* TakeVictim(struct victim_cache* vc, int block_number) {
+    struct victim_entry* entry = LookUpVictim(vc, block_number);
+    vc->lookups++;
+    if (entry == NULL) return NULL;
+
+    vc->hits++;
+    DecompressBlock(entry->data, entry->size, vc->taken);
+    RemoveVictim(vc, entry);
+    TrimHoles(vc);
+    return vc->taken;
+}
+
+void DropVictim(struct victim_cache* vc, int block_number) {
+    struct victim_entry* entry = LookUpVictim(vc, block_number);
+    if (entry == NULL) return;
+    RemoveVictim(vc, entry);
+    TrimHoles(vc);
+}
+
+void FillVictimStats(struct FsVictimStats* stats, struct victim_cache* vc) {
+    stats->budget = vc->budget;
+    stats->used = vc->used;
+    stats->blocks = vc->blocks;
+    stats->lookups = vc->lookups;
+    stats->hits = vc->hits;
+    stats->admitted = vc->admitted;
+    stats->admitted_bytes = vc->admitted_bytes;
+    stats->rejected = vc->rejected;
+}
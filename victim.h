@@ -0,0 +1,83 @@
+#ifndef COMP421_LAB3_VICTIM_H
+#define COMP421_LAB3_VICTIM_H
+
+#include "fsstats.h"
+
+#define VICTIM_MAX_PERCENT 50 //Largest compressed size kept, as a share of BLOCKSIZE
+#define VICTIM_HOLE 0 //Block number of an entry that no longer holds a block
+#define VICTIM_ENTRY_BYTES 256 //Budget bytes per entry the hash table is sized for, it is only searched on a miss
+
+/**
+ * Second tier behind the block cache partitions. Blocks a partition evicts
+ * are run length encoded and kept here until the byte budget runs out, the
+ * least recently evicted being dropped first. Inode and directory blocks are
+ * mostly zeros, so many of them fit in the space of one buffer.
+ *
+ * Entries live in one arena of budget bytes, allocated with the tier and
+ * used as a ring. A new entry is written at the head, and room is made by
+ * dropping entries at the tail, which are the least recently evicted. An
+ * entry taken out of the middle leaves a hole that is reclaimed when the
+ * tail reaches it. Entry headers count against the budget.
+ *
+ * A block is only ever in one place: a partition, the victim tier, or
+ * neither. Every block kept here matches its sector, since dirty blocks are
+ * written back before they are evicted.
+ */
+struct victim_entry {
+    int block_number; //VICTIM_HOLE once the entry has been taken or dropped
+    int size; //Bytes of data
+    struct victim_entry* prev_hash;
+    struct victim_entry* next_hash;
+    unsigned char data[1]; //Compressed block, stored right after the header in the arena
+};
+
+struct victim_cache {
+    unsigned char* arena; //budget bytes of entries
+    int head; //Offset the next entry is written at
+    int tail; //Offset of the least recently evicted entry
+    int lap_end; //End of the entries before the head wrapped to offset 0
+    int wrapped; //Whether entries run from tail to lap_end and then from 0 to head
+    int entries; //Entries in the arena, holes included
+    struct victim_entry** hash_set;
+    int hash_size;
+    int budget; //Size of the arena
+    int used; //Compressed bytes held, headers and holes left out
+    int blocks; //Entries held
+    int lookups; //Partition misses that consulted the tier
+    int hits; //Lookups served without reading the sector
+    int admitted; //Evicted blocks that were compressed and kept
+    int admitted_bytes; //Compressed size of the admitted blocks
+    int rejected; //Evicted blocks that did not compress well enough
+    unsigned char* scratch; //Compression output, BLOCKSIZE bytes
+    unsigned char* taken; //The block TakeVictim last expanded, BLOCKSIZE bytes
+};
+
+extern struct victim_cache* victim_cache; //NULL unless the server was started with a budget
+
+/**
+ * Creates the victim tier and makes it the one the block cache uses
+ * @param budget Bytes of compressed blocks the tier may hold
+ */
+struct victim_cache* CreateVictimCache(int budget);
+
+/**
+ * Keeps a compressed copy of a clean block that was just evicted
+ */
+void AddVictim(struct victim_cache* vc, int block_number, void* block);
+
+/**
+ * Takes a block out of the tier, before the partition it goes to evicts and
+ * admits another block that could reuse its space. The block is expanded
+ * into vc->taken, which stays valid until the next TakeVictim.
+ * @return vc->taken, or NULL if the block is not in the tier
+ */
+void* TakeVictim(struct victim_cache* vc, int block_number);
+
+/**
+ * Forgets a block that is about to be overwritten without being read
+ */
+void DropVictim(struct victim_cache* vc, int block_number);
+
+void FillVictimStats(struct FsVictimStats* stats, struct victim_cache* vc);
+
+#endif //COMP421_LAB3_VICTIM_H
@@ -6,27 +6,146 @@
 #include <comp421/filesystem.h>
 #include "yfs.h"
 #include "cache.h"
+#include "policy.h"
+#include "mrc.h"
+#include "victim.h"
+#include "cachectl.h"
 #include "buffer.h"
 #include "path.h"
 #include "packet.h"
 #include "dirname.h"
+#include "fsstats.h"
+#include "fsbitmap.h"
+#include "freelist.h"
 
 #define DEBUG 0
 #define DIRSIZE             (int)sizeof(struct dir_entry)
 #define MAX_DIRECT_SIZE     BLOCKSIZE * NUM_DIRECT
 #define MAX_INDIRECT_SIZE   BLOCKSIZE * (BLOCKSIZE / sizeof(int))
 #define MAX_FILE_SIZE       (int)(MAX_DIRECT_SIZE + MAX_INDIRECT_SIZE)
-#define INODE_PER_BLOCK     (BLOCKSIZE / INODESIZE)
 #define DIR_PER_BLOCK       (BLOCKSIZE / DIRSIZE)
 #define GET_DIR_COUNT(n)    (n / DIRSIZE)
+#define MIN_CACHESIZE       4   /* Handlers hold a few blocks/inodes at once */
+#define MAX_PINNED_FILES    16
+#define MAX_ADVISED_FILES   16
+#define MAX_PREFETCHES      8
+#define MAX_READ_STREAMS    16
+#define MAX_DEFERRED_FREES  32
+#define PREFETCH_CHUNK      8   /* Blocks prefetched after a reply or per idle round */
+#define IDLE_WRITEBACKS     8   /* Dirty blocks written per idle round */
+#define IDLE_FREES          1   /* Deleted files released per idle round */
+#define IDLE_SCAN_BLOCKS    2   /* Inode blocks the free space scan covers per idle round */
+#define RESERVE_BLOCKS      (NUM_DIRECT + (int)(BLOCKSIZE / sizeof(int)) + 2) /* Most blocks one request allocates */
+#define READAHEAD_MIN       2   /* Blocks read ahead once a file is read sequentially */
+#define READAHEAD_MAX       32  /* Largest readahead window, a quarter of the partition at most */
+#define HOT_LIST_SECTOR     0   /* The boot block, which the file system never uses */
+#define HOT_LIST_MAGIC      0x484f5431
+#define HOT_LIST_SLOTS      (int)(BLOCKSIZE / sizeof(int) - 2 - BLOCK_CLASSES)
 
-struct fs_header *header; /* Pointer to File System Header */
+/*
+ * A file pinned by MSG_PIN_FILE, with the blocks it had when it was pinned.
+ * Those are the blocks unpinning it releases, whatever the file became since.
+ */
+struct pinned_file {
+    int inum;
+    int num_blocks;
+    int *blocks;
+};
+
+struct pinned_file pinned_files[MAX_PINNED_FILES];
+int pinned_file_count = 0;
+
+/*
+ * The last NORMAL, SEQUENTIAL or RANDOM advice given for a file. Files
+ * without an entry are treated as ADVISE_NORMAL.
+ */
+struct file_advice {
+    int inum;
+    int advice;
+};
+
+struct file_advice advised_files[MAX_ADVISED_FILES];
+int advised_file_count = 0;
+int next_advice_slot = 0; /* Entry replaced when the table is full */
+
+/*
+ * Blocks of a file to fetch once the client that gave ADVISE_WILLNEED has
+ * its reply
+ */
+struct prefetch {
+    int inum;
+    int first_index; /* Index of the first block in the file */
+    int last_index;
+};
+
+struct prefetch prefetches[MAX_PREFETCHES];
+int prefetch_count = 0;
+
+/*
+ * A file being read, tracked to detect sequential reads. The window
+ * doubles with every read that starts where the previous one ended and
+ * drops to 0 on a read anywhere else.
+ */
+struct read_stream {
+    int inum;
+    int reuse;
+    int next_pos; /* Where the last read ended */
+    int window; /* Blocks to keep read ahead of the reader, 0 if reads are random */
+    int ahead_index; /* Index of the first block not yet read or queued for readahead */
+};
+
+struct read_stream read_streams[MAX_READ_STREAMS];
+int read_stream_count = 0;
+int next_stream_slot = 0; /* Entry replaced when the table is full */
 
-struct block_cache* block_stack; /* Cache for recently accessed blocks */
+/*
+ * Deleted files whose blocks and inode are not yet back on the free lists.
+ * Their inodes are already INODE_FREE, but keep their size and block
+ * numbers until ReleaseDeferredFrees truncates them.
+ */
+int deferred_frees[MAX_DEFERRED_FREES];
+int deferred_free_count = 0;
+int idle_rounds = 0; /* Times Receive returned 0 and there was work to do */
+
+/*
+ * Numbers of the cached inodes and blocks, saved at shutdown so the next
+ * server can start warm. Each group is most recently used first.
+ */
+struct hot_list {
+    int magic;
+    int num_inodes; /* Inode numbers at the start of numbers */
+    int num_blocks[BLOCK_CLASSES]; /* Block numbers of each class, following the inodes */
+    int numbers[HOT_LIST_SLOTS];
+};
+
+struct fs_bitmap_header *header; /* Pointer to File System Header */
+
+struct block_cache* block_stacks[BLOCK_CLASSES]; /* Caches for recently accessed blocks, one per block class */
 struct inode_cache* inode_stack; /* Cache for recently accessed inodes */
 
 struct buffer* free_inode_list; /* List of Inodes available to assign to files */
-struct buffer* free_block_list; /* List of blocks ready to allocate for file data */
+struct extent_list* free_extents; /* Runs of blocks ready to allocate for file data */
+unsigned char *block_bitmap; /* In use bit of every block, NULL if the disk has no bitmaps */
+unsigned char *inode_bitmap; /* In use bit of every inode */
+int bitmaps_dirty = 0; /* Bitmaps changed since they were copied to their blocks */
+
+/*
+ * Free space scan of a disk mounted without clean bitmaps. Requests are
+ * served while it runs: free inodes are usable as soon as it passes them,
+ * free blocks only once every inode has been scanned.
+ */
+unsigned char *scan_used = NULL; /* Blocks the scanned inodes hold, NULL when no scan is running */
+int scan_next_inum = 0; /* First inode the scan has not reached */
+struct inode scan_inodes[INODE_PER_BLOCK]; /* Inode block read by the scan */
+int scan_indirect[BLOCKSIZE / sizeof(int)]; /* Indirect block read by the scan */
+
+int metadata_cache_size = BLOCK_CACHESIZE / 2; /* Capacity of the metadata partition, set by -m */
+int block_cache_size = BLOCK_CACHESIZE - BLOCK_CACHESIZE / 2; /* Capacity of the data partition, set by -b */
+int inode_cache_size = INODE_CACHESIZE; /* Capacity of inode_stack, set by -i */
+char *block_cache_policy = "lru"; /* Replacement policy of both partitions, set by -p */
+int victim_cache_bytes = 0; /* Budget of the compressed victim tier, set by -v, 0 for none */
+int pinned_cache_size = 0; /* Blocks reserved for pinned files, set by -r, 0 for none */
+int request_counts[FS_STATS_OPCODES]; /* Requests received, indexed by packet type */
 
 /*
  * Simple helper for getting block count with inode->size
@@ -66,7 +185,7 @@ void PrintInode(struct inode *inode) {
     printf("block_count: %d\n", block_count);
 
     if (inode->size >= MAX_DIRECT_SIZE) {
-        indirect_block = GetBlock(inode->indirect)->block;
+        indirect_block = GetBlock(inode->indirect, BLOCK_METADATA)->block;
         printf("indirect blocks %d:\n", inode->indirect);
         for (i = 0; i < block_count - NUM_DIRECT; i++) {
             printf("\t- %d\n", indirect_block[i]);
@@ -84,7 +203,7 @@ void PrintInode(struct inode *inode) {
 
         if (block_id == 0) continue;
         if (inode->type == INODE_DIRECTORY) {
-            block = GetBlock(block_id)->block;
+            block = GetBlock(block_id, BLOCK_METADATA)->block;
             if ((i + 1) * BLOCKSIZE > inode->size) {
                 inner_count = dir_count % DIR_PER_BLOCK;
             } else {
@@ -97,7 +216,7 @@ void PrintInode(struct inode *inode) {
         }
 
         if (inode->type == INODE_REGULAR) {
-            char_block = GetBlock(block_id)->block;
+            char_block = GetBlock(block_id, BLOCK_DATA)->block;
             if ((i + 1) * BLOCKSIZE > inode->size) {
                 inner_count = inode->size % BLOCKSIZE;
             } else {
@@ -115,121 +234,396 @@ void PrintInode(struct inode *inode) {
     printf("----- End of Inode -----\n");
 }
 
-/**
- * Searches for a value in an array, if it's found swaps it with the value
- * at index. Helper function for GetFreeBlockList
- * @param arr Array that is to be swapped
- * @param size Size of the array
- * @param value Value that will be swapped
- * @param index Index to swap to
+/*
+ * Allocate the in-memory bitmaps of a disk made with them. They are read
+ * or rebuilt at mount, updated by every allocation and free, and copied to
+ * their blocks by SaveFreeBitmaps.
  */
-void SearchAndSwap(int arr[], int size, int value, int index) {
-    int i = -1;
-    int search_index = -1;
-    while (i != value && index < size) {
-        search_index++;
-        i = arr[search_index];
-    }
-    if (search_index == index || i == -1 || i > size) return;
-    int j = arr[index];
-    arr[index] = value;
-    arr[search_index] = j;
+void CreateFreeBitmaps() {
+    if (header->bitmap_magic != FS_BITMAP_MAGIC) return;
+    block_bitmap = calloc(BITMAP_BLOCKS(header->num_blocks), BLOCKSIZE);
+    inode_bitmap = calloc(BITMAP_BLOCKS(header->num_inodes + 1), BLOCKSIZE);
 }
 
-/**
- * Iterates through Inodes and pushes each free one to the buffer
+/*
+ * Mount a cleanly shut down disk: read the bitmaps and build both free
+ * lists from them, without reading a single inode
  */
-void GetFreeInodeList() {
-    free_inode_list = GetBuffer(header->num_inodes);
+void LoadFreeBitmaps() {
     int i;
-    for (i = 1; i <= header->num_inodes; i ++) {
-        struct inode *next = GetInode(i)->inode;
-        if (next->type == INODE_FREE) PushToBuffer(free_inode_list, i);
+
+    for (i = 0; i < BITMAP_BLOCKS(header->num_blocks); i++)
+        ReadDiskSector(header->block_bitmap + i, block_bitmap + i * BLOCKSIZE);
+    for (i = 0; i < BITMAP_BLOCKS(header->num_inodes + 1); i++)
+        ReadDiskSector(header->inode_bitmap + i, inode_bitmap + i * BLOCKSIZE);
+
+    free_extents = SweepFreeExtents(block_bitmap, header->num_blocks);
+    free_inode_list = GetBuffer(header->num_inodes);
+    for (i = 1; i <= header->num_inodes; i++) {
+        if (!GetBitmapBit(inode_bitmap, i)) PushToBuffer(free_inode_list, i);
     }
 }
 
-/**
- * Function initializes the list numbers for blocks that have not been allocated yet
+/*
+ * Private helper that clears the bit of every number in a free list,
+ * leaving the list as it was
+ */
+void ClearFreeBits(unsigned char *bitmap, struct buffer *free_list) {
+    int count = GetBufferCount(free_list);
+    int n;
+    while (count-- > 0) {
+        n = PopFromBuffer(free_list);
+        SetBitmapBit(bitmap, n, 0);
+        PushToBuffer(free_list, n);
+    }
+}
+
+/*
+ * Rebuild the bitmaps from the free lists a scan found, for a disk that
+ * has bitmaps but was not shut down cleanly
  */
-void GetFreeBlockList() {
-    /* Compute number of blocks occupited by inodes */
-    int inode_count = header->num_inodes + 1;
-    int inode_block_count = inode_count / INODE_PER_BLOCK;
-    if (inode_count % INODE_PER_BLOCK > 0) inode_block_count++;
-
-    /* Compute number of blocks with inodes and boot block excluded */
-    int block_count = header->num_blocks - inode_block_count - 1;
-    int first_data_block = 1 + inode_block_count;
-    int *buffer = malloc(block_count * sizeof(int));
+void BuildFreeBitmaps() {
     int i;
+    int j;
 
-    /* Block 0 is the boot block and not used by the file system */
-    for (i = 0; i < block_count; i++) {
-        buffer[i] = i + first_data_block;
+    memset(block_bitmap, 0xff, BITMAP_BLOCKS(header->num_blocks) * BLOCKSIZE);
+    memset(inode_bitmap, 0xff, BITMAP_BLOCKS(header->num_inodes + 1) * BLOCKSIZE);
+    for (i = 0; i < free_extents->count; i++) {
+        for (j = 0; j < free_extents->extents[i].length; j++)
+            SetBitmapBit(block_bitmap, free_extents->extents[i].start + j, 0);
     }
+    ClearFreeBits(inode_bitmap, free_inode_list);
+    bitmaps_dirty = 1;
+}
 
+int IsDeferredFree(int inum) {
+    int i;
+    for (i = 0; i < deferred_free_count; i++) {
+        if (deferred_frees[i] == inum) return 1;
+    }
+    return 0;
+}
 
-    /* Iterate through inodes to check which ones are using blocks */
-    int j;
-    int pos;
-    int busy_blocks = 0;
-    struct inode *scan;
-    for (i = 1; i <= header->num_inodes; i ++) {
-        scan = GetInode(i)->inode;
-
-        /* Iterate through direct array to find first blocks */
-        j = 0;
-        pos = 0;
-        while (pos < scan->size && j < NUM_DIRECT) {
-            SearchAndSwap(buffer, block_count, scan->direct[j], busy_blocks);
-            busy_blocks++;
-            j++;
-            pos += BLOCKSIZE;
+/*
+ * Start the free space scan. Until it has marked every inode's blocks the
+ * free block list stays empty, and FreeBlock only clears the freed block's
+ * mark, so the sweep at the end finds it.
+ */
+void StartFreeSpaceScan() {
+    int num_blocks = header->num_blocks;
+
+    scan_used = calloc(BITMAP_BLOCKS(num_blocks), BLOCKSIZE);
+    scan_next_inum = 1;
+    free_inode_list = GetBuffer(header->num_inodes);
+    free_extents = CreateExtentList(num_blocks);
+
+    /* The boot block, the header and inode blocks, and the bitmaps belong to no file */
+    MarkBlockRange(scan_used, num_blocks, 0, 1 + GetBlockCount((header->num_inodes + 1) * INODESIZE));
+    if (block_bitmap != NULL) {
+        MarkBlockRange(scan_used, num_blocks, header->block_bitmap, BITMAP_BLOCKS(num_blocks));
+        MarkBlockRange(scan_used, num_blocks, header->inode_bitmap, BITMAP_BLOCKS(header->num_inodes + 1));
+    }
+}
+
+/*
+ * Private helper that ends the scan: sweep the marks into the free block
+ * list and rebuild the bitmaps from the finished lists
+ */
+void EndFreeSpaceScan() {
+    struct extent_list *found = SweepFreeExtents(scan_used, header->num_blocks);
+
+    free(free_extents->extents);
+    free(free_extents);
+    free_extents = found;
+    free(scan_used);
+    scan_used = NULL;
+    if (block_bitmap != NULL) BuildFreeBitmaps();
+}
+
+/*
+ * Return the inodes of an inode block for a walk over every inode that must
+ * leave the caches alone: the cached block if there is one, else a copy
+ * read into scan_inodes. Cached inodes are newer than their block, see
+ * PeekCachedInode.
+ */
+struct inode *PeekInodeBlock(int block_num) {
+    struct inode *inodes = PeekCachedBlock(block_num);
+    if (inodes == NULL) {
+        ReadDiskSector(block_num, scan_inodes);
+        inodes = scan_inodes;
+    }
+    return inodes;
+}
+
+/*
+ * Return the indirect block of a file the same way, NULL if it has none
+ */
+int *PeekIndirectBlock(struct inode *inode) {
+    int *indirect_block;
+
+    if (inode->size <= MAX_DIRECT_SIZE || inode->indirect <= 0 || inode->indirect >= header->num_blocks) return NULL;
+    indirect_block = PeekCachedBlock(inode->indirect);
+    if (indirect_block == NULL) {
+        ReadDiskSector(inode->indirect, scan_indirect);
+        indirect_block = scan_indirect;
+    }
+    return indirect_block;
+}
+
+/*
+ * Scan the rest of the inode block the scan is in: push the free inodes and
+ * mark the blocks of the others. Nothing goes through the caches, so a scan
+ * leaves them alone and can run in the middle of a request.
+ */
+void ScanInodeBlock() {
+    struct inode *inodes = PeekInodeBlock(1 + scan_next_inum / INODE_PER_BLOCK);
+    struct inode *inode;
+
+    do {
+        inode = PeekCachedInode(scan_next_inum);
+        if (inode == NULL) inode = &inodes[scan_next_inum % INODE_PER_BLOCK];
+
+        /* A deleted file still holds its blocks until it is released */
+        if (inode->type == INODE_FREE && !IsDeferredFree(scan_next_inum)) {
+            PushToBuffer(free_inode_list, scan_next_inum);
+        } else {
+            MarkFileBlocks(scan_used, header->num_blocks, inode, PeekIndirectBlock(inode));
         }
-        /*
-         * If indirect array is a non-zero value add it to the allocated block
-         * and the array that's contained
-         */
-        if (pos < scan->size) {
-            SearchAndSwap(buffer, header->num_blocks, scan->indirect, busy_blocks);
-            busy_blocks++;
-            int *indirect_blocks = GetBlock(scan->indirect)->block;
-            j = 0;
-            while (j < 128 && pos < scan->size) {
-                SearchAndSwap(buffer, header->num_blocks, indirect_blocks[j], busy_blocks);
-                busy_blocks++;
-                j++;
-                pos += BLOCKSIZE;
+        scan_next_inum++;
+    } while (scan_next_inum <= header->num_inodes && scan_next_inum % INODE_PER_BLOCK != 0);
+
+    if (scan_next_inum > header->num_inodes) EndFreeSpaceScan();
+}
+
+/*
+ * Measure how fragmented regular files are. A file read in order seeks once
+ * per run of consecutive blocks, counting its indirect block when it sits
+ * between the blocks before and after it. Walks every inode the way the
+ * free space scan does.
+ */
+void CountFileRuns(struct FsFileRuns *stats) {
+    struct inode *inodes = NULL;
+    struct inode *inode;
+    int *indirect_block;
+    int block_count;
+    int block_num;
+    int prev_block;
+    int inum;
+    int i;
+
+    for (inum = 1; inum <= header->num_inodes; inum++) {
+        if (inodes == NULL || inum % INODE_PER_BLOCK == 0) inodes = PeekInodeBlock(1 + inum / INODE_PER_BLOCK);
+        inode = PeekCachedInode(inum);
+        if (inode == NULL) inode = &inodes[inum % INODE_PER_BLOCK];
+        if (inode->type != INODE_REGULAR || inode->size == 0) continue;
+
+        indirect_block = PeekIndirectBlock(inode);
+        block_count = GetBlockCount(inode->size);
+        prev_block = 0;
+        stats->files++;
+        for (i = 0; i < block_count; i++) {
+            if (i < NUM_DIRECT) {
+                block_num = inode->direct[i];
+            } else {
+                if (indirect_block == NULL || i - NUM_DIRECT >= (int)(BLOCKSIZE / sizeof(int))) break;
+                if (i == NUM_DIRECT && prev_block != 0 && inode->indirect == prev_block + 1) prev_block = inode->indirect;
+                block_num = indirect_block[i - NUM_DIRECT];
             }
+            /* Holes are never read from the disk */
+            if (block_num == 0) continue;
+            stats->file_blocks++;
+            if (block_num != prev_block + 1) stats->file_runs++;
+            prev_block = block_num;
+        }
+    }
+}
+
+/*
+ * Scan until a free inode is found or no inodes are left
+ */
+void ScanForFreeInode() {
+    while (scan_used != NULL && GetBufferCount(free_inode_list) == 0) ScanInodeBlock();
+}
+
+/*
+ * Scan every inode left, so that all free blocks are on the list
+ */
+void FinishFreeSpaceScan() {
+    while (scan_used != NULL) ScanInodeBlock();
+}
+
+/*
+ * Copy changed bitmaps into their blocks, for SyncCache to write
+ */
+void SaveFreeBitmaps() {
+    struct block_cache_entry *entry;
+    int i;
+
+    /* Bitmaps are incomplete until the scan ends */
+    if (block_bitmap == NULL || !bitmaps_dirty || scan_used != NULL) return;
+    for (i = 0; i < BITMAP_BLOCKS(header->num_blocks); i++) {
+        entry = GetBlockForOverwrite(header->block_bitmap + i, BLOCK_METADATA);
+        memcpy(entry->block, block_bitmap + i * BLOCKSIZE, BLOCKSIZE);
+        MarkBlockDirty(entry);
+    }
+    for (i = 0; i < BITMAP_BLOCKS(header->num_inodes + 1); i++) {
+        entry = GetBlockForOverwrite(header->inode_bitmap + i, BLOCK_METADATA);
+        memcpy(entry->block, inode_bitmap + i * BLOCKSIZE, BLOCKSIZE);
+        MarkBlockDirty(entry);
+    }
+    bitmaps_dirty = 0;
+}
+
+/*
+ * Write the header's clean flag straight to disk. It is cleared at mount,
+ * so bitmaps left behind by a crash are never trusted, and set once a
+ * shutdown has synced everything.
+ */
+void SetCleanFlag(int clean) {
+    struct block_cache_entry *entry;
+
+    if (block_bitmap == NULL) return;
+    header->clean = clean;
+    entry = GetBlock(1, BLOCK_METADATA);
+    ((struct fs_bitmap_header *)entry->block)->clean = clean;
+    MarkBlockDirty(entry);
+    WriteBackBlock(entry);
+}
+
+/*
+ * Take a free block for a file, the one after prev_block when it is free,
+ * see AllocExtentBlock. run is how many blocks the caller is about to take
+ * in a row.
+ */
+int AllocBlock(int prev_block, int run) {
+    FinishFreeSpaceScan();
+    int block_num = AllocExtentBlock(free_extents, prev_block, run);
+    if (block_bitmap != NULL) {
+        SetBitmapBit(block_bitmap, block_num, 1);
+        bitmaps_dirty = 1;
+    }
+    return block_num;
+}
+
+/*
+ * Release the blocks a file pinned. Blocks another pinned file still uses
+ * stay in the reserved space, the others go back to their partitions.
+ * Return 0, or -1 if the file is not pinned
+ */
+int UnpinFileBlocks(int inum) {
+    struct block_cache_entry *entry;
+    int i;
+
+    for (i = 0; i < pinned_file_count && pinned_files[i].inum != inum; i++);
+    if (i == pinned_file_count) return -1;
+    struct pinned_file file = pinned_files[i];
+    pinned_files[i] = pinned_files[--pinned_file_count];
+
+    for (i = 0; i < file.num_blocks; i++) {
+        entry = LookUpBlock(pinned_blocks, file.blocks[i]);
+        assert(entry != NULL && entry->file_pins > 0);
+        if (--entry->file_pins == 0) UnpinCachedBlock(entry);
+    }
+    free(file.blocks);
+    return 0;
+}
+
+/*
+ * Take a freed block off the lists of the pinned files that held it, so
+ * unpinning them later does not look for it
+ */
+void ForgetPinnedBlock(int block_num) {
+    struct pinned_file *file;
+    int i;
+    int j;
+
+    for (i = 0; i < pinned_file_count; i++) {
+        file = &pinned_files[i];
+        for (j = 0; j < file->num_blocks; j++) {
+            if (file->blocks[j] != block_num) continue;
+            file->blocks[j--] = file->blocks[file->num_blocks - 1];
+            file->num_blocks--;
         }
     }
+}
+
+/*
+ * Put a block back on the free list, or while the free space scan runs
+ * clear its mark so the sweep finds it. Its cached copy is dropped, so a
+ * dirty block of a deleted file is never written back.
+ */
+void FreeBlock(int block_num) {
+    if (scan_used != NULL) SetBitmapBit(scan_used, block_num, 0);
+    else FreeExtentBlock(free_extents, block_num);
+    ForgetPinnedBlock(block_num);
+    DropCachedBlock(block_num);
+    if (block_bitmap != NULL) {
+        SetBitmapBit(block_bitmap, block_num, 0);
+        bitmaps_dirty = 1;
+    }
+}
+
+int AllocInode() {
+    ScanForFreeInode();
+    int inum = PopFromBuffer(free_inode_list);
+    if (inode_bitmap != NULL) {
+        SetBitmapBit(inode_bitmap, inum, 1);
+        bitmaps_dirty = 1;
+    }
+    return inum;
+}
+
+/*
+ * Forget a deleted file's advice, read stream and queued prefetches, so a
+ * file that reuses its inode number starts with none of them
+ */
+void ForgetFileAccess(int inum) {
+    int i;
+
+    for (i = 0; i < advised_file_count && advised_files[i].inum != inum; i++);
+    if (i < advised_file_count) advised_files[i] = advised_files[--advised_file_count];
+
+    for (i = 0; i < read_stream_count && read_streams[i].inum != inum; i++);
+    if (i < read_stream_count) read_streams[i] = read_streams[--read_stream_count];
 
-    /* Initialize a special buffer */
-    free_block_list = malloc(sizeof(struct buffer));
-    free_block_list->size = block_count;
-    free_block_list->b = buffer;
-    free_block_list->in = free_block_list->size;
-    free_block_list->out = 0;
-    free_block_list->empty = 0;
-    free_block_list->full = 1;
+    for (i = 0; i < prefetch_count; i++) {
+        if (prefetches[i].inum != inum) continue;
+        prefetch_count--;
+        memmove(&prefetches[i], &prefetches[i + 1], (prefetch_count - i) * sizeof(struct prefetch));
+        i--;
+    }
+}
 
-    int k;
-    for (k = 0; k < busy_blocks; k++) {
-        PopFromBuffer(free_block_list);
+/*
+ * Put an inode back on the free list, unless the free space scan has yet
+ * to reach it and will find it free itself
+ */
+void FreeInode(int inum) {
+    /* A deleted file no longer pins its inode block */
+    UnpinFileBlocks(inum);
+    ForgetFileAccess(inum);
+    if (scan_used == NULL || inum < scan_next_inum) PushToBuffer(free_inode_list, inum);
+    if (inode_bitmap != NULL) {
+        SetBitmapBit(inode_bitmap, inum, 0);
+        bitmaps_dirty = 1;
     }
 }
 
 /*
- * Create a new file inode using provided arguments
+ * Create a new file inode using provided arguments.
+ * Return NULL, leaving the inode as it was, if a directory gets no block
  */
 struct inode* CreateFileInode(int new_inum, int parent_inum, short type) {
     struct inode_cache_entry *inode_entry = GetInode(new_inum);
     struct inode *inode = inode_entry->inode;
     struct block_cache_entry *block_entry;
     struct dir_entry *block;
+    int dir_block = 0;
+
+    if (type == INODE_DIRECTORY && (dir_block = AllocBlock(0, 1)) == 0) return NULL;
 
     /* New inode is created and it is dirty */
-    inode_entry->dirty = 1;
+    MarkInodeDirty(inode_entry);
     inode->type = type;
     inode->size = 0;
     inode->nlink = 0;
@@ -239,10 +633,9 @@ struct inode* CreateFileInode(int new_inum, int parent_inum, short type) {
     if (type == INODE_DIRECTORY) {
         inode->nlink = 1; /* Link to itself */
         inode->size = sizeof(struct dir_entry) * 2;
-        inode->direct[0] = PopFromBuffer(free_block_list);
+        inode->direct[0] = dir_block;
 
-        block_entry = GetBlock(inode->direct[0]);
-        block_entry->dirty = 1;
+        block_entry = GetNewBlock(inode->direct[0], BLOCK_METADATA);
         block = block_entry->block;
         block[0].inum = new_inum;
         block[1].inum = parent_inum;
@@ -263,9 +656,7 @@ struct inode* TruncateFileInode(int target_inum) {
     struct block_cache_entry *indirect_block_entry;
     int *indirect_block = NULL;
 
-    entry = GetInode(target_inum);
-    entry->dirty = 1;
-    inode = entry->inode;
+    MarkInodeDirty(entry);
 
     int block_count = GetBlockCount(inode->size);
     int i;
@@ -274,25 +665,28 @@ struct inode* TruncateFileInode(int target_inum) {
     int iterate_count = block_count;
     if (block_count > NUM_DIRECT) {
         iterate_count = NUM_DIRECT;
-        indirect_block_entry = GetBlock(inode->indirect);
+        indirect_block_entry = GetBlock(inode->indirect, BLOCK_METADATA);
         indirect_block = indirect_block_entry->block;
-        indirect_block_entry->dirty = 1;
+        MarkBlockDirty(indirect_block_entry);
         for (i = 0; i < block_count - NUM_DIRECT; i++) {
             if (indirect_block[i] != 0) {
                 if (DEBUG) printf("Freed block: %d\n", indirect_block[i]);
-                PushToBuffer(free_block_list, indirect_block[i]);
+                FreeBlock(indirect_block[i]);
             }
         }
         if (inode->indirect != 0) {
             if (DEBUG) printf("Freed block: %d\n", inode->indirect);
-            PushToBuffer(free_block_list, inode->indirect);
+            FreeBlock(inode->indirect);
+            inode->indirect = 0;
         }
     }
 
+    /* Leave no pointer to a freed block, it may be handed out again */
     for (i = 0; i < iterate_count; i++) {
         if (inode->direct[i] != 0) {
             if (DEBUG) printf("Freed block: %d\n", inode->direct[i]);
-            PushToBuffer(free_block_list, inode->direct[i]);
+            FreeBlock(inode->direct[i]);
+            inode->direct[i] = 0;
         }
     }
 
@@ -300,20 +694,92 @@ struct inode* TruncateFileInode(int target_inum) {
     return inode;
 }
 
+/*
+ * Give back blocks first_index to last_index, which a write that failed
+ * allocated past the end of a file, and the indirect block if new_indirect
+ * says the write created it. The caller must have unpinned the indirect
+ * block.
+ */
+void FreeBlocksPastEnd(struct inode *inode, int first_index, int last_index, int new_indirect) {
+    struct block_cache_entry *indirect_block_entry;
+    int *indirect_block;
+    int i;
+
+    for (i = first_index; i <= last_index && i < NUM_DIRECT; i++) {
+        if (inode->direct[i] == 0) continue;
+        FreeBlock(inode->direct[i]);
+        inode->direct[i] = 0;
+    }
+    if (inode->indirect == 0 || (last_index < NUM_DIRECT && !new_indirect)) return;
+
+    indirect_block_entry = GetBlock(inode->indirect, BLOCK_METADATA);
+    indirect_block = indirect_block_entry->block;
+    for (i = first_index > NUM_DIRECT ? first_index : NUM_DIRECT; i <= last_index; i++) {
+        if (indirect_block[i - NUM_DIRECT] == 0) continue;
+        FreeBlock(indirect_block[i - NUM_DIRECT]);
+        indirect_block[i - NUM_DIRECT] = 0;
+        MarkBlockDirty(indirect_block_entry);
+    }
+    if (new_indirect) {
+        FreeBlock(inode->indirect);
+        inode->indirect = 0;
+    }
+}
+
+/*
+ * Get and pin the indirect block of inode, unless the caller already did.
+ * It stays pinned until the caller unpins it, so the data block misses in
+ * between cannot recycle its buffer.
+ */
+int *PinIndirectBlock(struct inode *inode, struct block_cache_entry **indirect_block_entry) {
+    if (*indirect_block_entry == NULL) {
+        *indirect_block_entry = GetBlock(inode->indirect, BLOCK_METADATA);
+        PinBlock(*indirect_block_entry);
+    }
+    return (*indirect_block_entry)->block;
+}
+
+/*
+ * Get the number of the block at index in a file, pinning its indirect
+ * block like PinIndirectBlock if the index needs it.
+ * Return 0 if the block is a hole
+ */
+int GetFileBlockNumber(struct inode *inode, int index, struct block_cache_entry **indirect_block_entry) {
+    if (index < NUM_DIRECT) return inode->direct[index];
+    /* A hole may cover the whole indirect range */
+    if (inode->indirect == 0) return 0;
+    return PinIndirectBlock(inode, indirect_block_entry)[index - NUM_DIRECT];
+}
+
+/*
+ * Allocate a new, zero filled indirect block for inode after prev_block and
+ * pin it like PinIndirectBlock does. run is passed on to AllocBlock.
+ * Return NULL if no block is free
+ */
+int *PinNewIndirectBlock(struct inode *inode, struct block_cache_entry **indirect_block_entry, int prev_block, int run) {
+    inode->indirect = AllocBlock(prev_block, run);
+    if (inode->indirect == 0) return NULL;
+    *indirect_block_entry = GetNewBlock(inode->indirect, BLOCK_METADATA);
+    PinBlock(*indirect_block_entry);
+    return (*indirect_block_entry)->block;
+}
+
 /*
  * Register provided inum and dirname to directory inode.
- * Return 1 if parent inode becomes dirty for this action.
+ * Return 1 if parent inode becomes dirty for this action, or -1 if the
+ * directory needs a new block and none is free.
  */
 int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
     /* Verify against number of new blocks required */
     struct block_cache_entry *block_entry;
-    struct block_cache_entry *indirect_block_entry;
+    struct block_cache_entry *indirect_block_entry = NULL;
     struct dir_entry *block;
     int *indirect_block = NULL;
     int dir_index = 0;
     int prev_index = -1;
     int outer_index; /* index of direct or indirect */
     int inner_index; /* index of dir_entry array */
+    int block_num;
 
     /* Similar process as SearchDirectory to find available inum */
     for (; dir_index < GET_DIR_COUNT(parent_inode->size); dir_index++) {
@@ -323,13 +789,11 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
         /* Get block if outer_index is incremented */
         if (prev_index != outer_index) {
             if (outer_index >= NUM_DIRECT) {
-                if (indirect_block == NULL) {
-                    indirect_block = GetBlock(parent_inode->indirect)->block;
-                }
-                block_entry = GetBlock(indirect_block[outer_index - NUM_DIRECT]);
+                indirect_block = PinIndirectBlock(parent_inode, &indirect_block_entry);
+                block_entry = GetBlock(indirect_block[outer_index - NUM_DIRECT], BLOCK_METADATA);
                 block = block_entry->block;
             } else {
-                block_entry = GetBlock(parent_inode->direct[outer_index]);
+                block_entry = GetBlock(parent_inode->direct[outer_index], BLOCK_METADATA);
                 block = block_entry->block;
             }
             prev_index = outer_index;
@@ -339,7 +803,8 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
         if (block[inner_index].inum == 0) {
             block[inner_index].inum = new_inum;
             SetDirectoryName(block[inner_index].name, dirname, 0, DIRNAMELEN);
-            block_entry->dirty = 1;
+            MarkBlockDirty(block_entry);
+            if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
             return 0;
         }
     }
@@ -348,12 +813,12 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
     if (parent_inode->size >= MAX_DIRECT_SIZE) {
         /* If it just reached MAX_DIRECT_SIZE, need extra block for indirect */
         if (parent_inode->size == MAX_DIRECT_SIZE) {
-            parent_inode->indirect = PopFromBuffer(free_block_list);
+            indirect_block = PinNewIndirectBlock(parent_inode, &indirect_block_entry, parent_inode->direct[NUM_DIRECT - 1], 2);
+            if (indirect_block == NULL) return -1;
+        } else {
+            indirect_block = PinIndirectBlock(parent_inode, &indirect_block_entry);
         }
 
-        indirect_block_entry = GetBlock(parent_inode->indirect);
-        indirect_block = indirect_block_entry->block;
-
         outer_index = (parent_inode->size - MAX_DIRECT_SIZE) / BLOCKSIZE;
         inner_index = GET_DIR_COUNT(parent_inode->size) % DIR_PER_BLOCK;
 
@@ -362,11 +827,22 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
          * that means it is time to allocate new block.
          */
         if (inner_index == 0) {
-            indirect_block[outer_index] = PopFromBuffer(free_block_list);
-            indirect_block_entry->dirty = 1;
+            block_num = AllocBlock(outer_index > 0 ? indirect_block[outer_index - 1] : parent_inode->indirect, 1);
+            if (block_num == 0) {
+                UnpinBlock(indirect_block_entry);
+                /* Take back the indirect block made for this entry */
+                if (outer_index == 0) {
+                    FreeBlock(parent_inode->indirect);
+                    parent_inode->indirect = 0;
+                }
+                return -1;
+            }
+            indirect_block[outer_index] = block_num;
+            MarkBlockDirty(indirect_block_entry);
+            block_entry = GetNewBlock(indirect_block[outer_index], BLOCK_METADATA);
+        } else {
+            block_entry = GetBlock(indirect_block[outer_index], BLOCK_METADATA);
         }
-
-        block_entry = GetBlock(indirect_block[outer_index]);
         block = block_entry->block;
     } else {
         outer_index = parent_inode->size / BLOCKSIZE;
@@ -376,19 +852,24 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
          * that means it is time to allocate new block.
          */
         if (inner_index == 0) {
-            parent_inode->direct[outer_index] = PopFromBuffer(free_block_list);
+            block_num = AllocBlock(outer_index > 0 ? parent_inode->direct[outer_index - 1] : 0, 1);
+            if (block_num == 0) return -1;
+            parent_inode->direct[outer_index] = block_num;
+            block_entry = GetNewBlock(parent_inode->direct[outer_index], BLOCK_METADATA);
+        } else {
+            block_entry = GetBlock(parent_inode->direct[outer_index], BLOCK_METADATA);
         }
 
         if (DEBUG) printf("parent_inode->direct[outer_index]: %d\n", parent_inode->direct[outer_index]);
-        block_entry = GetBlock(parent_inode->direct[outer_index]);
         block = block_entry->block;
     }
 
     /* Register inum and dirname in the dir_entry */
     block[inner_index].inum = new_inum;
     SetDirectoryName(block[inner_index].name, dirname, 0, DIRNAMELEN);
-    block_entry->dirty = 1;
+    MarkBlockDirty(block_entry);
     parent_inode->size += DIRSIZE;
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
     return 1;
 }
 
@@ -397,6 +878,7 @@ int RegisterDirectory(struct inode* parent_inode, int new_inum, char *dirname) {
  * Return -1 if target inum is not found.
  */
 int UnregisterDirectory(struct inode* parent_inode, int target_inum) {
+    struct block_cache_entry *indirect_block_entry = NULL;
     int *indirect_block = NULL;
     struct block_cache_entry *block_entry;
     struct dir_entry *block;
@@ -404,6 +886,7 @@ int UnregisterDirectory(struct inode* parent_inode, int target_inum) {
     int prev_index = -1;
     int outer_index;
     int inner_index;
+    int result = -1;
 
     for (; dir_index < GET_DIR_COUNT(parent_inode->size); dir_index++) {
         outer_index = dir_index / DIR_PER_BLOCK;
@@ -412,13 +895,11 @@ int UnregisterDirectory(struct inode* parent_inode, int target_inum) {
         /* Get block if outer_index is incremented */
         if (prev_index != outer_index) {
             if (outer_index >= NUM_DIRECT) {
-                if (indirect_block == NULL) {
-                    indirect_block = GetBlock(parent_inode->indirect)->block;
-                }
-                block_entry = GetBlock(indirect_block[outer_index - NUM_DIRECT]);
+                indirect_block = PinIndirectBlock(parent_inode, &indirect_block_entry);
+                block_entry = GetBlock(indirect_block[outer_index - NUM_DIRECT], BLOCK_METADATA);
                 block = block_entry->block;
             } else {
-                block_entry = GetBlock(parent_inode->direct[outer_index]);
+                block_entry = GetBlock(parent_inode->direct[outer_index], BLOCK_METADATA);
                 block = block_entry->block;
             }
             prev_index = outer_index;
@@ -427,12 +908,14 @@ int UnregisterDirectory(struct inode* parent_inode, int target_inum) {
         /* Found it! */
         if (block[inner_index].inum == target_inum) {
             block[inner_index].inum = 0;
-            block_entry->dirty = 1;
-            return 0;
+            MarkBlockDirty(block_entry);
+            result = 0;
+            break;
         }
     }
 
-    return -1;
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+    return result;
 }
 
 /*
@@ -440,12 +923,14 @@ int UnregisterDirectory(struct inode* parent_inode, int target_inum) {
  * find inode number which matches with dirname.
  */
 int SearchDirectory(struct inode *inode, char *dirname) {
+    struct block_cache_entry *indirect_block_entry = NULL;
     int *indirect_block = NULL;
     struct dir_entry *block;
     int dir_index = 0;
     int prev_index = -1;
     int outer_index; /* index of direct or indirect */
     int inner_index; /* index of dir_entry array */
+    int found_inum = 0;
 
     for (; dir_index < GET_DIR_COUNT(inode->size); dir_index++) {
         outer_index = dir_index / DIR_PER_BLOCK;
@@ -454,23 +939,23 @@ int SearchDirectory(struct inode *inode, char *dirname) {
         /* Get block if outer_index is incremented */
         if (prev_index != outer_index) {
             if (outer_index >= NUM_DIRECT) {
-                if (indirect_block == NULL) {
-                    indirect_block = GetBlock(inode->indirect)->block;
-                }
-                block = GetBlock(indirect_block[outer_index - NUM_DIRECT])->block;
+                indirect_block = PinIndirectBlock(inode, &indirect_block_entry);
+                block = GetBlock(indirect_block[outer_index - NUM_DIRECT], BLOCK_METADATA)->block;
             } else {
-                block = GetBlock(inode->direct[outer_index])->block;
+                block = GetBlock(inode->direct[outer_index], BLOCK_METADATA)->block;
             }
             prev_index = outer_index;
         }
 
         if (block[inner_index].inum == 0) continue;
         if (CompareDirname(block[inner_index].name, dirname) == 0) {
-            return block[inner_index].inum;
+            found_inum = block[inner_index].inum;
+            break;
         }
     }
 
-    return 0;
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+    return found_inum;
 }
 
 /*
@@ -479,7 +964,7 @@ int SearchDirectory(struct inode *inode, char *dirname) {
  */
 int CleanDirectory(struct inode *inode) {
     int dirty = 0;
-    struct block_cache_entry *indirect_block_entry;
+    struct block_cache_entry *indirect_block_entry = NULL;
     struct dir_entry *block;
     int *indirect_block = NULL;
     int dir_index = GET_DIR_COUNT(inode->size) - 1;
@@ -495,31 +980,29 @@ int CleanDirectory(struct inode *inode) {
         /* Get block if outer_index is incremented */
         if (prev_index != outer_index) {
             if (outer_index >= NUM_DIRECT) {
-                if (indirect_block == NULL) {
-                    indirect_block_entry = GetBlock(inode->indirect);
-                    indirect_block = indirect_block_entry->block;
-                }
-                block = GetBlock(indirect_block[outer_index - NUM_DIRECT])->block;
+                indirect_block = PinIndirectBlock(inode, &indirect_block_entry);
+                block = GetBlock(indirect_block[outer_index - NUM_DIRECT], BLOCK_METADATA)->block;
             } else {
-                block = GetBlock(inode->direct[outer_index])->block;
+                block = GetBlock(inode->direct[outer_index], BLOCK_METADATA)->block;
             }
 
             /* If block is switched 2nd+ time, that block needs to be freed */
             if (prev_index > 0) {
                 if (prev_index >= NUM_DIRECT) {
-                    if (indirect_block[outer_index - NUM_DIRECT] != 0) {
+                    if (indirect_block[prev_index - NUM_DIRECT] != 0) {
                         if (DEBUG) printf("Freeing block: %d\n", indirect_block[prev_index - NUM_DIRECT]);
-                        PushToBuffer(free_block_list, indirect_block[prev_index - NUM_DIRECT]);
+                        FreeBlock(indirect_block[prev_index - NUM_DIRECT]);
                     }
 
                     /* Need to free indirect block as well */
                     if (prev_index == NUM_DIRECT && inode->indirect != 0) {
                         if (DEBUG) printf("Freeing block: %d\n", inode->indirect);
-                        PushToBuffer(free_block_list, inode->indirect);
+                        FreeBlock(inode->indirect);
+                        inode->indirect = 0;
                     }
                 } else if (inode->direct[prev_index] != 0) {
                     if (DEBUG) printf("Freeing block: %d\n", inode->direct[prev_index]);
-                    PushToBuffer(free_block_list, inode->direct[prev_index]);
+                    FreeBlock(inode->direct[prev_index]);
                 }
             }
             prev_index = outer_index;
@@ -533,9 +1016,290 @@ int CleanDirectory(struct inode *inode) {
         inode->size -= DIRSIZE;
     }
 
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
     return dirty;
 }
 
+/*
+ * Append a block to the blocks a file pins, unless max are listed already
+ * Return the new count, or -1 if the list is full
+ */
+int AppendPinBlock(int *blocks, int *classes, int count, int max, int block_num, int block_class) {
+    if (count >= max) return -1;
+    blocks[count] = block_num;
+    classes[count] = block_class;
+    return count + 1;
+}
+
+/*
+ * List the blocks of a file: its inode block, its data blocks and its
+ * indirect block, with the class each is cached as.
+ * Return the number of blocks, or -1 if there are more than max
+ */
+int GetFileBlocks(int inum, int *blocks, int *classes, int max) {
+    struct inode *inode = GetInode(inum)->inode;
+    struct block_cache_entry *indirect_block_entry = NULL;
+    int data_class = inode->type == INODE_DIRECTORY ? BLOCK_METADATA : BLOCK_DATA;
+    int block_count = GetBlockCount(inode->size);
+    int *indirect;
+    int count;
+    int i;
+
+    count = AppendPinBlock(blocks, classes, 0, max, inum / INODE_PER_BLOCK + 1, BLOCK_METADATA);
+    for (i = 0; i < block_count && i < NUM_DIRECT && count >= 0; i++) {
+        if (inode->direct[i] > 0) count = AppendPinBlock(blocks, classes, count, max, inode->direct[i], data_class);
+    }
+    if (block_count <= NUM_DIRECT || inode->indirect <= 0 || count < 0) return count;
+
+    count = AppendPinBlock(blocks, classes, count, max, inode->indirect, BLOCK_METADATA);
+    indirect = PinIndirectBlock(inode, &indirect_block_entry);
+    for (i = 0; i < block_count - NUM_DIRECT && count >= 0; i++) {
+        if (indirect[i] > 0) count = AppendPinBlock(blocks, classes, count, max, indirect[i], data_class);
+    }
+    UnpinBlock(indirect_block_entry);
+    return count;
+}
+
+/*
+ * Move every block of a file into the space reserved for pinned files, so
+ * it is never evicted. Pinning a pinned file again does nothing.
+ * Return 0, or -1 if there is no reserved space or not enough of it left
+ */
+int PinFileBlocks(int inum) {
+    struct pinned_file *file;
+    int *blocks;
+    int *classes;
+    int count;
+    int needed = 0;
+    int i;
+
+    if (pinned_blocks == NULL || inum < 1 || inum > header->num_inodes) return -1;
+    if (GetInode(inum)->inode->type == INODE_FREE) return -1;
+    for (i = 0; i < pinned_file_count; i++) {
+        if (pinned_files[i].inum == inum) return 0;
+    }
+    if (pinned_file_count == MAX_PINNED_FILES) return -1;
+
+    blocks = malloc(pinned_blocks->capacity * sizeof(int));
+    classes = malloc(pinned_blocks->capacity * sizeof(int));
+    count = GetFileBlocks(inum, blocks, classes, pinned_blocks->capacity);
+
+    /* Blocks shared with a pinned file, like the inode block, are there already */
+    for (i = 0; i < count; i++) {
+        if (LookUpBlock(pinned_blocks, blocks[i]) == NULL) needed++;
+    }
+    if (count < 0 || pinned_blocks->stack_size + needed > pinned_blocks->capacity) {
+        free(blocks);
+        free(classes);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        PinCachedBlock(blocks[i], classes[i])->file_pins++;
+    }
+    free(classes);
+
+    file = &pinned_files[pinned_file_count++];
+    file->inum = inum;
+    file->num_blocks = count;
+    file->blocks = blocks;
+    return 0;
+}
+
+/*
+ * Return the advice in effect for a file
+ */
+int GetFileAdvice(int inum) {
+    int i;
+    for (i = 0; i < advised_file_count; i++) {
+        if (advised_files[i].inum == inum) return advised_files[i].advice;
+    }
+    return ADVISE_NORMAL;
+}
+
+/*
+ * Record NORMAL, SEQUENTIAL or RANDOM advice for a file
+ */
+void SetFileAdvice(int inum, int advice) {
+    int i;
+    for (i = 0; i < advised_file_count && advised_files[i].inum != inum; i++);
+
+    if (advice == ADVISE_NORMAL) {
+        if (i < advised_file_count) advised_files[i] = advised_files[--advised_file_count];
+        return;
+    }
+    if (i == advised_file_count) {
+        /* Table is full, forget some other file's advice */
+        if (advised_file_count == MAX_ADVISED_FILES) {
+            i = next_advice_slot;
+            next_advice_slot = (next_advice_slot + 1) % MAX_ADVISED_FILES;
+        } else {
+            advised_file_count++;
+        }
+    }
+    advised_files[i].inum = inum;
+    advised_files[i].advice = advice;
+}
+
+/*
+ * Fetch up to max blocks of the ranges ADVISE_WILLNEED and ReadAhead asked
+ * for, oldest range first. Called once the client has its reply, so the
+ * reads overlap with whatever it does next, and while the server is idle.
+ * What is left stays queued for the next call.
+ * Return the number of blocks looked at
+ */
+int RunPrefetches(int max) {
+    struct block_cache_entry *indirect_block_entry;
+    struct inode *inode;
+    struct prefetch *range;
+    int block_class;
+    int block_count;
+    int block_id;
+    int done = 0;
+
+    while (prefetch_count > 0 && done < max) {
+        range = &prefetches[0];
+        inode = GetInode(range->inum)->inode;
+        block_count = GetBlockCount(inode->size);
+        if (inode->type == INODE_FREE) block_count = 0;
+
+        block_class = inode->type == INODE_DIRECTORY ? BLOCK_METADATA : BLOCK_DATA;
+        indirect_block_entry = NULL;
+        for (; range->first_index <= range->last_index && range->first_index < block_count && done < max; range->first_index++) {
+            block_id = GetFileBlockNumber(inode, range->first_index, &indirect_block_entry);
+            if (block_id == 0) continue;
+            PrefetchBlock(block_id, block_class);
+            done++;
+        }
+        if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+
+        /* Range finished, or cut short by the end of the file */
+        if (range->first_index > range->last_index || range->first_index >= block_count) {
+            prefetch_count--;
+            memmove(&prefetches[0], &prefetches[1], prefetch_count * sizeof(struct prefetch));
+        }
+    }
+    return done;
+}
+
+/*
+ * Give the blocks and inode of up to max deleted files back to the free
+ * lists, oldest first.
+ * Return the number of files released
+ */
+int ReleaseDeferredFrees(int max) {
+    int inum;
+    int done;
+
+    for (done = 0; done < max && deferred_free_count > 0; done++) {
+        inum = deferred_frees[0];
+        deferred_free_count--;
+        memmove(&deferred_frees[0], &deferred_frees[1], deferred_free_count * sizeof(int));
+        if (DEBUG) printf("Releasing inode: %d\n", inum);
+        TruncateFileInode(inum);
+        FreeInode(inum);
+    }
+    return done;
+}
+
+/*
+ * Called when Receive returns 0, that is when every process is blocked.
+ * Does one bounded round of background work, so a request arriving in the
+ * meantime waits for at most one round: first the free space scan moves
+ * on, then deleted files are released, then queued prefetches are read,
+ * then dirty inodes and blocks are written back.
+ * Return 1 if there was anything to do
+ */
+int RunIdleWork() {
+    int i;
+
+    if (scan_used != NULL) {
+        for (i = 0; i < IDLE_SCAN_BLOCKS && scan_used != NULL; i++) ScanInodeBlock();
+        return 1;
+    }
+    if (ReleaseDeferredFrees(IDLE_FREES) > 0) return 1;
+    if (RunPrefetches(PREFETCH_CHUNK) > 0) return 1;
+
+    if (inode_stack->dirty_list != NULL) {
+        WriteBackInode(inode_stack->dirty_list);
+        return 1;
+    }
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        if (CleanDirtyBlocks(block_stacks[i], IDLE_WRITEBACKS) > 0) return 1;
+    }
+    if (pinned_blocks != NULL && CleanDirtyBlocks(pinned_blocks, IDLE_WRITEBACKS) > 0) return 1;
+    return 0;
+}
+
+/*
+ * Return the stream of a file, starting a new one at offset 0 if the file
+ * has none or the inode was reused since
+ */
+struct read_stream *GetReadStream(int inum, int reuse) {
+    int i;
+    for (i = 0; i < read_stream_count && read_streams[i].inum != inum; i++);
+
+    if (i == read_stream_count) {
+        /* Table is full, forget some other file's stream */
+        if (read_stream_count == MAX_READ_STREAMS) {
+            i = next_stream_slot;
+            next_stream_slot = (next_stream_slot + 1) % MAX_READ_STREAMS;
+        } else {
+            read_stream_count++;
+        }
+    } else if (read_streams[i].reuse == reuse) {
+        return &read_streams[i];
+    }
+    read_streams[i].inum = inum;
+    read_streams[i].reuse = reuse;
+    read_streams[i].next_pos = 0;
+    read_streams[i].window = 0;
+    read_streams[i].ahead_index = 0;
+    return &read_streams[i];
+}
+
+/*
+ * Called by ReadFile before it reads blocks start_index to end_index. If
+ * the read continues the file's stream, queue the blocks up to window
+ * beyond end_index that are not already queued, for RunPrefetches to read
+ * once the client has its reply. ADVISE_RANDOM turns this off for a file,
+ * ADVISE_SEQUENTIAL starts it at the largest window.
+ */
+void ReadAhead(struct inode *inode, int inum, int pos, int size, int end_index) {
+    int block_class = inode->type == INODE_DIRECTORY ? BLOCK_METADATA : BLOCK_DATA;
+    int max_window = block_stacks[block_class]->capacity / 4;
+    int advice = GetFileAdvice(inum);
+    struct read_stream *stream;
+    int last_index;
+
+    if (advice == ADVISE_RANDOM) return;
+    if (max_window > READAHEAD_MAX) max_window = READAHEAD_MAX;
+    if (max_window < 1) return;
+
+    stream = GetReadStream(inum, inode->reuse);
+    if (pos != stream->next_pos) {
+        stream->window = 0;
+        stream->ahead_index = 0;
+    } else if (stream->window == 0) stream->window = advice == ADVISE_SEQUENTIAL ? max_window : READAHEAD_MIN;
+    else stream->window *= 2;
+    if (stream->window > max_window) stream->window = max_window;
+    stream->next_pos = pos + size;
+    if (stream->window == 0) return;
+
+    last_index = end_index + stream->window;
+    if (last_index >= GetBlockCount(inode->size)) last_index = GetBlockCount(inode->size) - 1;
+    if (stream->ahead_index <= end_index) stream->ahead_index = end_index + 1;
+    if (stream->ahead_index > last_index) return;
+
+    /* Too many pending ranges, try again on the next read */
+    if (prefetch_count == MAX_PREFETCHES) return;
+    prefetches[prefetch_count].inum = inum;
+    prefetches[prefetch_count].first_index = stream->ahead_index;
+    prefetches[prefetch_count].last_index = last_index;
+    prefetch_count++;
+    stream->ahead_index = last_index + 1;
+}
+
 /*************************
  * File Request Hanlders *
  *************************/
@@ -596,6 +1360,7 @@ void CreateFile(void *packet, int pid, short type) {
     struct inode_cache_entry *parent_entry;
     struct inode *parent_inode;
     struct inode *new_inode;
+    int registered;
 
     char dirname[DIRNAMELEN];
     int parent_inum = ((DataPacket *)packet)->arg1;
@@ -635,27 +1400,56 @@ void CreateFile(void *packet, int pid, short type) {
         new_inode = TruncateFileInode(target_inum);
     } else {
         /* If no free inode to spare, error */
-        if (free_inode_list->size == 0) {
+        if (GetBufferCount(free_inode_list) == 0) {
             ((FilePacket *)packet)->inum = -3;
             return;
         }
 
         /*
-         * Creating a directory will require 1 block.
-         * Adding it to parent inode may require 2 blocks.
+         * Creating a directory will require 1 block. Adding it to the
+         * parent needs a new block when the parent's last block is full,
+         * and an indirect block too when that was its last direct block.
+         * Free blocks are only all known once the free space scan is done.
          */
-        if (free_block_list->size < 3) {
+        int needed = type == INODE_DIRECTORY ? 1 : 0;
+        if (parent_inode->size % BLOCKSIZE == 0) needed += parent_inode->size == MAX_DIRECT_SIZE ? 2 : 1;
+        if (needed > 0) FinishFreeSpaceScan();
+        if (free_extents->free_blocks < needed && deferred_free_count > 0) {
+            /* Releasing deleted files fetches their inodes */
+            PinInode(parent_entry);
+            ReleaseDeferredFrees(deferred_free_count);
+            UnpinInode(parent_entry);
+        }
+        if (free_extents->free_blocks < needed) {
             ((FilePacket *)packet)->inum = -4;
             return;
         }
 
         // Create new file if not found
-        target_inum = PopFromBuffer(free_inode_list);
+        target_inum = AllocInode();
+        registered = RegisterDirectory(parent_inode, target_inum, dirname);
+        if (registered < 0) {
+            FreeInode(target_inum);
+            ((FilePacket *)packet)->inum = -4;
+            return;
+        }
+        if (registered) MarkInodeDirty(parent_entry);
+
+        PinInode(parent_entry);
         new_inode = CreateFileInode(target_inum, parent_inum, type);
+        UnpinInode(parent_entry);
+        if (new_inode == NULL) {
+            UnregisterDirectory(parent_inode, target_inum);
+            FreeInode(target_inum);
+            ((FilePacket *)packet)->inum = -4;
+            return;
+        }
 
         /* Child directory refers to parent via .. */
-        if (type == INODE_DIRECTORY) parent_inode->nlink += 1;
-        parent_entry->dirty = RegisterDirectory(parent_inode, target_inum, dirname);
+        if (type == INODE_DIRECTORY) {
+            parent_inode->nlink += 1;
+            MarkInodeDirty(parent_entry);
+        }
 
         if (DEBUG) {
             printf("Printing parent inode %d after creating new file\n", parent_inum);
@@ -729,8 +1523,9 @@ void ReadFile(DataPacket *packet, int pid) {
     char hole_buffer[BLOCKSIZE];
     memset(hole_buffer, 0, BLOCKSIZE);
 
-    /* Start reading from the blocks */
-    int *indirect_block = NULL;
+    /* Start reading from the blocks, directories are read as metadata */
+    int block_class = inode->type == INODE_DIRECTORY ? BLOCK_METADATA : BLOCK_DATA;
+    struct block_cache_entry *indirect_block_entry = NULL;
     char *block;
     int block_id;
     int copied_size = 0;
@@ -738,21 +1533,18 @@ void ReadFile(DataPacket *packet, int pid) {
     int copysize;
     int outer_index;
 
-    /* Prefetch indirect block */
-    if (inode->size >= MAX_DIRECT_SIZE) {
-        indirect_block = GetBlock(inode->indirect)->block;
-    }
+    /* A file read front to back once should not push out other blocks */
+    int sequential = GetFileAdvice(inum) == ADVISE_SEQUENTIAL;
+
+    ReadAhead(inode, inum, pos, size, end_index);
 
     for (outer_index = start_index; outer_index <= end_index; outer_index++) {
-        if (outer_index >= NUM_DIRECT) {
-            block_id = indirect_block[outer_index - NUM_DIRECT];
-        } else {
-            block_id = inode->direct[outer_index];
-        }
+        block_id = GetFileBlockNumber(inode, outer_index, &indirect_block_entry);
 
         /* Use hole block if block does not exist */
-        if (block_id != 0) block = GetBlock(block_id)->block;
-        else block = hole_buffer;
+        if (block_id == 0) block = hole_buffer;
+        else if (sequential) block = GetBlockOnce(block_id, block_class)->block;
+        else block = GetBlock(block_id, block_class)->block;
 
         /*
          * If current_pos is not divisible by BLOCKSIZE,
@@ -778,6 +1570,7 @@ void ReadFile(DataPacket *packet, int pid) {
         }
     }
 
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
     if (DEBUG) printf("Final copied size: %d\n", copied_size);
     packet->arg1 = copied_size;
 }
@@ -823,7 +1616,7 @@ void WriteFile(DataPacket *packet, int pid) {
         return;
     }
 
-    struct block_cache_entry *indirect_block_entry;
+    struct block_cache_entry *indirect_block_entry = NULL;
     int *indirect_block = NULL;
     int inode_block_count = GetBlockCount(inode->size);
     int start_index = pos / BLOCKSIZE; /* Block index where writing starts */
@@ -831,11 +1624,6 @@ void WriteFile(DataPacket *packet, int pid) {
     /* ex) if pos = 0 and size = 512, it should only iterate 0 ~ 0 */
     if ((pos + size) % BLOCKSIZE == 0) end_index--;
 
-    /* Prefetch indirect block */
-    if (inode->size >= MAX_DIRECT_SIZE) {
-        indirect_block = GetBlock(inode->indirect)->block;
-    }
-
     /*
      * Start iterating from whichever the lowest between start and block count.
      * - Increase size if end_index is greater than block_count.
@@ -859,59 +1647,89 @@ void WriteFile(DataPacket *packet, int pid) {
     for (i = start_index; i <= end_index; i++) {
         /* Increase the size if current index is less than or equal to block count */
         if (inode_block_count <= i) {
-            /* If i is at NUM_DIRECT, it is about to create indirect */
-            if (i == NUM_DIRECT) extra_blocks++;
-
             /* Assign new block if size increased AND is part of writing range */
             if (i >= start_index) extra_blocks++;
         }
     }
 
-    if (free_block_list->size <= extra_blocks) {
-        ((FilePacket *)packet)->inum = -4;
+    /* The indirect block is created by the first write past the direct blocks */
+    if (inode_block_count <= NUM_DIRECT && end_index >= NUM_DIRECT) extra_blocks++;
+
+    if (free_extents->free_blocks < extra_blocks) {
+        packet->arg1 = -4;
         return;
     }
 
+    /* New blocks go after the file's last block when they extend it */
+    int prev_block = 0;
+    int run;
+    if (outer_index == inode_block_count && outer_index > 0)
+        prev_block = GetFileBlockNumber(inode, outer_index - 1, &indirect_block_entry);
+
+    /* What to give back if the write fails */
+    int first_new_index = outer_index;
+    int new_indirect = 0;
+
     for (; outer_index <= end_index; outer_index++) {
+        /*
+         * Blocks to find room for if the next block is taken: the rest of
+         * the write, or as many as the file already has, since a file
+         * written a block at a time will likely keep growing
+         */
+        run = end_index - outer_index + 1;
+        if (run < outer_index) run = outer_index;
+
         /* Increase the size if current index is less than or equal to block count */
         if (inode_block_count <= outer_index) {
-            /* If i is at NUM_DIRECT, it is about to create indirect */
-            if (outer_index == NUM_DIRECT) {
-                inode->indirect = PopFromBuffer(free_block_list);
-                indirect_block_entry = GetBlock(inode->indirect);
-                indirect_block = indirect_block_entry->block;
-                indirect_block_entry->dirty = 1;
-                memset(indirect_block, 0, BLOCKSIZE);
+            /*
+             * Create the indirect block the first time the file grows past
+             * the direct blocks, even if the write skips over them.
+             */
+            if (outer_index >= NUM_DIRECT && inode_block_count <= NUM_DIRECT && indirect_block_entry == NULL) {
+                indirect_block = PinNewIndirectBlock(inode, &indirect_block_entry, prev_block, run + 1);
+                MarkInodeDirty(inode_entry);
+                if (indirect_block == NULL) break;
+                new_indirect = 1;
+                prev_block = inode->indirect;
             }
 
-            /* Constantly get indirect block since it gets dirty many times */
-            if (outer_index > NUM_DIRECT) {
-                indirect_block_entry = GetBlock(inode->indirect);
-                indirect_block = indirect_block_entry->block;
-                indirect_block_entry->dirty = 1;
+            /* Indirect block stays pinned since it gets dirty many times */
+            if (outer_index >= NUM_DIRECT) {
+                indirect_block = PinIndirectBlock(inode, &indirect_block_entry);
+                MarkBlockDirty(indirect_block_entry);
             }
 
             /* Assign new block if size increased AND is part of writing range */
             if (outer_index >= start_index) {
                 if (outer_index >= NUM_DIRECT) {
                     /* Create new block in indirect block. */
-                    indirect_block[outer_index - NUM_DIRECT] = PopFromBuffer(free_block_list);
+                    indirect_block[outer_index - NUM_DIRECT] = AllocBlock(prev_block, run);
+                    if (indirect_block[outer_index - NUM_DIRECT] == 0) break;
+                    prev_block = indirect_block[outer_index - NUM_DIRECT];
                     if (DEBUG) printf("Create new block for indirect: %d (block: %d)\n", outer_index - NUM_DIRECT, indirect_block[outer_index - NUM_DIRECT]);
-                    block = GetBlock(indirect_block[outer_index - NUM_DIRECT])->block;
-                    memset(block, 0, BLOCKSIZE);
+                    GetNewBlock(indirect_block[outer_index - NUM_DIRECT], BLOCK_DATA);
                 } else {
                     /* Create new block at direct */
-                    inode->direct[outer_index] = PopFromBuffer(free_block_list);
+                    inode->direct[outer_index] = AllocBlock(prev_block, run);
+                    MarkInodeDirty(inode_entry);
+                    if (inode->direct[outer_index] == 0) break;
+                    prev_block = inode->direct[outer_index];
                     if (DEBUG) printf("Create new block at outer_index: %d (block: %d)\n", outer_index, inode->direct[outer_index]);
-                    block = GetBlock(inode->direct[outer_index])->block;
-                    memset(block, 0, BLOCKSIZE);
-                    inode_entry->dirty = 1;
+                    GetNewBlock(inode->direct[outer_index], BLOCK_DATA);
                     if (DEBUG) printf("inode->direct[outer_index]: %d\n", inode->direct[outer_index]);
                 }
             }
         }
     }
 
+    /* Out of free blocks, give back the ones this write took */
+    if (outer_index <= end_index) {
+        if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+        FreeBlocksPastEnd(inode, first_new_index, outer_index, new_indirect);
+        packet->arg1 = -4;
+        return;
+    }
+
     /* Start writing in the block */
     int block_id;
     int prefix = 0;
@@ -931,13 +1749,12 @@ void WriteFile(DataPacket *packet, int pid) {
 
     for (outer_index = start_index; outer_index <= end_index; outer_index++) {
         if (outer_index >= NUM_DIRECT) {
+            indirect_block = PinIndirectBlock(inode, &indirect_block_entry);
             block_id = indirect_block[outer_index - NUM_DIRECT];
         } else {
             block_id = inode->direct[outer_index];
         }
 
-        block_entry = GetBlock(block_id);
-        block = block_entry->block;
         /*
          * If current_pos is not divisible by BLOCKSIZE,
          * this does not start from the beginning of the block.
@@ -955,17 +1772,31 @@ void WriteFile(DataPacket *packet, int pid) {
             copysize = size - copied_size;
         }
 
+        /* Old contents of a block that is overwritten entirely need not be read */
+        if (copysize == BLOCKSIZE) block_entry = GetBlockForOverwrite(block_id, BLOCK_DATA);
+        else block_entry = GetBlock(block_id, BLOCK_DATA);
+        block = block_entry->block;
+
         if (DEBUG) {
             printf("Copyfrom - prefix: %d\n", prefix);
             printf("Copyfrom - copied_size: %d\n", copied_size);
             printf("Copyfrom - copysize: %d\n", copysize);
         }
 
-        CopyFrom(pid, block + prefix, buffer + copied_size, copysize);
+        if (CopyFrom(pid, block + prefix, buffer + copied_size, copysize) < 0) {
+            /* A block installed for overwrite still holds another block's bytes */
+            if (copysize == BLOCKSIZE) AbandonOverwrite(block_entry);
+            if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+            /* The size stays as it was, so the blocks allocated past it go back */
+            FreeBlocksPastEnd(inode, first_new_index, end_index, new_indirect);
+            packet->arg1 = -5;
+            return;
+        }
         copied_size += copysize;
-        block_entry->dirty = 1;
+        MarkBlockDirty(block_entry);
     }
     new_size += copied_size;
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
     if (DEBUG) {
         printf("Final copied size: %d\n", copied_size);
         printf("Old file size: %d\n", inode->size);
@@ -973,7 +1804,7 @@ void WriteFile(DataPacket *packet, int pid) {
     }
     if (new_size > inode->size) {
         inode->size = new_size;
-        inode_entry->dirty = 1;
+        MarkInodeDirty(inode_entry);
     }
     packet->arg1 = copied_size;
 
@@ -1014,7 +1845,9 @@ void DeleteDir(DataPacket *packet) {
         return;
     }
 
+    PinInode(parent_entry);
     target_entry = GetInode(target_inum);
+    UnpinInode(parent_entry);
     target_inode = target_entry->inode;
 
     /* Cannot call deleteDir on non-directory */
@@ -1035,32 +1868,41 @@ void DeleteDir(DataPacket *packet) {
         return;
     }
 
-    target_entry->dirty = 1;
+    MarkInodeDirty(target_entry);
     target_inode->type = INODE_FREE;
     target_inode->size = 0;
     target_inode->nlink = 0;
 
     /* Clean parent directory */
-    parent_entry->dirty = CleanDirectory(parent_inode);
+    if (CleanDirectory(parent_inode)) MarkInodeDirty(parent_entry);
 
     struct block_cache_entry *block_entry;
     struct dir_entry *block;
+    int dotdot_inum = 0;
     int i;
 
-    block_entry = GetBlock(target_inode->direct[0]);
-    block_entry->dirty = 1;
+    block_entry = GetBlock(target_inode->direct[0], BLOCK_METADATA);
+    MarkBlockDirty(block_entry);
     block = block_entry->block;
 
-    /* Need to decrement nlink of the parent */
     for (i = 0; i < 2; i++) {
-        if (block[i].name[1] == '.') {
-            target_entry = GetInode(block[i].inum);
-            target_entry->inode->nlink -= 1;
-            target_entry->dirty = 1;
-        }
+        if (block[i].name[1] == '.') dotdot_inum = block[i].inum;
         block[i].inum = 0;
     }
 
+    /* The directory's only block and its inode can be reused now */
+    FreeBlock(target_inode->direct[0]);
+    FreeInode(target_inum);
+
+    /* Need to decrement nlink of the parent, after we are done with block */
+    if (dotdot_inum != 0) {
+        PinInode(parent_entry);
+        target_entry = GetInode(dotdot_inum);
+        UnpinInode(parent_entry);
+        target_entry->inode->nlink -= 1;
+        MarkInodeDirty(target_entry);
+    }
+
     if (DEBUG) {
         printf("Parent inode after dir is deleted.\n");
         PrintInode(parent_inode);
@@ -1072,6 +1914,7 @@ void CreateLink(DataPacket *packet, int pid) {
     struct inode_cache_entry *parent_entry;
     struct inode *target_inode;
     struct inode *parent_inode;
+    int registered;
 
     char dirname[DIRNAMELEN];
     int target_inum = packet->arg1;
@@ -1097,7 +1940,9 @@ void CreateLink(DataPacket *packet, int pid) {
         return;
     }
 
+    PinInode(target_entry);
     parent_entry = GetInode(parent_inum);
+    UnpinInode(target_entry);
     parent_inode = parent_entry->inode;
 
     /* Already checked by client but just to be sure */
@@ -1110,14 +1955,19 @@ void CreateLink(DataPacket *packet, int pid) {
      * Creating a directory will require 1 block.
      * Adding it to parent inode may require 2 blocks.
      */
-    if (free_block_list->size < 2) {
+    if (free_extents->free_blocks < 2) {
         packet->arg1 = -4;
         return;
     }
 
-    parent_entry->dirty = RegisterDirectory(parent_inode, target_inum, dirname);
+    registered = RegisterDirectory(parent_inode, target_inum, dirname);
+    if (registered < 0) {
+        packet->arg1 = -4;
+        return;
+    }
+    if (registered) MarkInodeDirty(parent_entry);
     target_inode->nlink += 1;
-    target_entry->dirty = 1;
+    MarkInodeDirty(target_entry);
 
     if (DEBUG) {
         printf("Parent inode after link is created.");
@@ -1147,28 +1997,38 @@ void DeleteLink(DataPacket *packet) {
         return;
     }
 
+    /* Truncating the target may fetch it again */
+    PinInode(parent_entry);
     target_entry = GetInode(target_inum);
     target_inode = target_entry->inode;
 
     /* Remove inum from parent inode */
     if (UnregisterDirectory(parent_inode, target_inum) < 0) {
+        UnpinInode(parent_entry);
         packet->arg1 = -2;
         return;
     }
 
-    target_entry->dirty = 1;
+    MarkInodeDirty(target_entry);
     target_inode->nlink -= 1;
 
     /* Target Inode is linked no more */
     if (target_inode->nlink == 0) {
-        TruncateFileInode(target_inum);
         if (DEBUG) printf("Deleting inode: %d\n", target_inum);
         target_inode->type = INODE_FREE;
-        PushToBuffer(free_inode_list, target_inum);
+
+        /* Freeing the blocks may read the indirect block, leave it for idle time */
+        if (deferred_free_count < MAX_DEFERRED_FREES) {
+            deferred_frees[deferred_free_count++] = target_inum;
+        } else {
+            TruncateFileInode(target_inum);
+            FreeInode(target_inum);
+        }
     }
+    UnpinInode(parent_entry);
 
     /* Clean parent directory */
-    parent_entry->dirty = CleanDirectory(parent_inode);
+    if (CleanDirectory(parent_inode)) MarkInodeDirty(parent_entry);
 
     if (DEBUG) {
         printf("Parent inode after link is deleted.\n");
@@ -1180,53 +2040,383 @@ void DeleteLink(DataPacket *packet) {
  * Writes all Dirty Inodes
  */
 void SyncCache() {
+    /**
+     * Write-back is not a lookup by a request, keep it out of the miss ratio curves
+     */
+    int recording = record_lookups;
+    record_lookups = 0;
+
+    /**
+     * Deleted files go to the disk as free inodes with no blocks
+     */
+    ReleaseDeferredFrees(deferred_free_count);
+    SaveFreeBitmaps();
+
     /**
      * Synchronize Inodes in Cache to Blocks in Cache
      */
-    struct inode_cache_entry* inode;
-    //PrintInodeCacheHashSet(inode_stack);
-    //PrintInodeCacheStack(inode_stack);
-    for (inode = inode_stack->top; inode != NULL; inode = inode->next_lru) {
-        if (inode->dirty) {
-            struct block_cache_entry* inode_block_entry = GetBlock((inode->inum / 8) + 1);
-            if (DEBUG) printf("Syncing Inode %d to block %d\n",inode->inum,inode_block_entry->block_number);
-            void* inode_block = inode_block_entry->block;
-            inode_block_entry->dirty = 1;
-            struct inode* overwrite = (struct inode *)inode_block + (inode->inum % 8);
-            memcpy(overwrite, inode->inode, sizeof(inode));
-            inode->dirty = 0;
-        }
+    while (inode_stack->dirty_list != NULL) {
+        if (DEBUG) printf("Syncing Inode %d\n", inode_stack->dirty_list->inum);
+        WriteBackInode(inode_stack->dirty_list);
     }
 
     /**
-     * Synchronize Blocks in Cache to Disk
+     * Synchronize Blocks in Cache to Disk, in ascending sector order
      */
-    struct block_cache_entry* block;
-    for (block = block_stack->top; block != NULL; block = block->next_lru) {
-        if (block->dirty) {
-            if (DEBUG) printf("Syncing Block %d\n",block->block_number);
-            WriteSector(block->block_number,block->block);
-            block->dirty = 0;
+    int sectors = 0;
+    int runs = 0;
+    int i;
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        SyncDirtyBlocks(block_stacks[i]);
+        sectors += block_stacks[i]->last_sync_sectors;
+        runs += block_stacks[i]->last_sync_runs;
+    }
+    if (pinned_blocks != NULL) {
+        SyncDirtyBlocks(pinned_blocks);
+        sectors += pinned_blocks->last_sync_sectors;
+        runs += pinned_blocks->last_sync_runs;
+    }
+    if (DEBUG) printf("Sync: wrote %d sectors in %d runs\n", sectors, runs);
+    record_lookups = recording;
+    return;
+}
+
+/*
+ * Appends a partition's block numbers to the hot list, the frequent list
+ * first since it holds the blocks worth keeping longest
+ * @return Number of blocks appended
+ */
+int SaveHotBlocks(struct hot_list *list, int used, struct block_cache *stack) {
+    struct block_cache_entry *entry;
+    int count = 0;
+    int i;
+
+    for (i = LIST_FREQUENT; i >= LIST_RECENT; i--) {
+        for (entry = stack->lists[i].top; entry != NULL && used + count < HOT_LIST_SLOTS; entry = entry->next_lru) {
+            if (entry->block_number > 0) list->numbers[used + count++] = entry->block_number;
         }
     }
-    return;
+    return count;
+}
+
+/*
+ * Records the cached inode and block numbers in the boot block. Called at
+ * shutdown once the caches are synced.
+ */
+void SaveHotList() {
+    struct hot_list *list = calloc(1, SECTORSIZE);
+    struct inode_cache_entry *entry;
+    int used = 0;
+
+    list->magic = HOT_LIST_MAGIC;
+    for (entry = inode_stack->top; entry != NULL && used < HOT_LIST_SLOTS; entry = entry->next_lru) {
+        if (entry->inum > 0) list->numbers[used++] = entry->inum;
+    }
+    list->num_inodes = used;
+    list->num_blocks[BLOCK_METADATA] = SaveHotBlocks(list, used, block_stacks[BLOCK_METADATA]);
+    used += list->num_blocks[BLOCK_METADATA];
+    list->num_blocks[BLOCK_DATA] = SaveHotBlocks(list, used, block_stacks[BLOCK_DATA]);
+
+    if (WriteDiskSector(HOT_LIST_SECTOR, list) < 0) fprintf(stderr, "Cannot save the hot list.\n");
+    free(list);
+}
+
+/*
+ * Reads the hot list the last server saved and fetches what it names, least
+ * recently used first, so every cache ends up in the order it was saved in.
+ * Inodes go first because fetching them also fetches their inode blocks.
+ * A missing or damaged list leaves the caches as they are.
+ */
+void LoadHotList() {
+    struct hot_list *list = malloc(SECTORSIZE);
+    int first[BLOCK_CLASSES];
+    int i;
+    int j;
+
+    if (ReadDiskSector(HOT_LIST_SECTOR, list) < 0 || list->magic != HOT_LIST_MAGIC ||
+        list->num_inodes < 0 || list->num_blocks[BLOCK_METADATA] < 0 || list->num_blocks[BLOCK_DATA] < 0 ||
+        list->num_inodes + list->num_blocks[BLOCK_METADATA] + list->num_blocks[BLOCK_DATA] > HOT_LIST_SLOTS) {
+        free(list);
+        return;
+    }
+
+    for (i = list->num_inodes - 1; i >= 0; i--) {
+        if (list->numbers[i] >= 1 && list->numbers[i] <= header->num_inodes) GetInode(list->numbers[i]);
+    }
+
+    first[BLOCK_METADATA] = list->num_inodes;
+    first[BLOCK_DATA] = first[BLOCK_METADATA] + list->num_blocks[BLOCK_METADATA];
+    for (j = 0; j < BLOCK_CLASSES; j++) {
+        for (i = first[j] + list->num_blocks[j] - 1; i >= first[j]; i--) {
+            if (list->numbers[i] >= 1 && list->numbers[i] < header->num_blocks) GetBlock(list->numbers[i], j);
+        }
+    }
+    free(list);
+}
+
+/*
+ * Pin (arg2 = 1) or unpin (arg2 = 0) the blocks of file arg1 in the cache
+ */
+void SetFilePinned(DataPacket *packet) {
+    int inum = packet->arg1;
+    int pin = packet->arg2;
+
+    /* Bleach packet for reuse */
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_PIN_FILE;
+    packet->arg1 = pin ? PinFileBlocks(inum) : UnpinFileBlocks(inum);
+}
+
+/*
+ * Take access pattern advice for file arg1, covering arg3 bytes from arg2
+ * (0 bytes meaning up to the end of the file). See cachectl.h.
+ */
+void AdviseFile(DataPacket *packet) {
+    struct block_cache_entry *indirect_block_entry = NULL;
+    struct inode *inode;
+    int inum = packet->arg1;
+    int offset = packet->arg2;
+    int len = packet->arg3;
+    int advice = packet->arg4;
+    int first_index;
+    int last_index;
+    int block_class;
+    int block_id;
+    int index;
+
+    /* Bleach packet for reuse */
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_ADVISE;
+
+    if (inum < 1 || inum > header->num_inodes || offset < 0 || len < 0) {
+        packet->arg1 = -1;
+        return;
+    }
+    inode = GetInode(inum)->inode;
+    if (inode->type == INODE_FREE) {
+        packet->arg1 = -1;
+        return;
+    }
+
+    if (advice == ADVISE_NORMAL || advice == ADVISE_SEQUENTIAL || advice == ADVISE_RANDOM) {
+        SetFileAdvice(inum, advice);
+        packet->arg1 = 0;
+        return;
+    }
+    if (advice != ADVISE_WILLNEED && advice != ADVISE_DONTNEED) {
+        packet->arg1 = -1;
+        return;
+    }
+
+    /* Nothing is cached beyond the end of the file */
+    packet->arg1 = 0;
+    if (offset >= inode->size) return;
+    if (len == 0 || len > inode->size - offset) len = inode->size - offset;
+    first_index = offset / BLOCKSIZE;
+    last_index = (offset + len - 1) / BLOCKSIZE;
+
+    if (advice == ADVISE_WILLNEED) {
+        /* Too many pending ranges, the advice is only a hint */
+        if (prefetch_count == MAX_PREFETCHES) return;
+        /* More than half a partition would evict the range's start */
+        block_class = inode->type == INODE_DIRECTORY ? BLOCK_METADATA : BLOCK_DATA;
+        if (last_index - first_index >= block_stacks[block_class]->capacity / 2)
+            last_index = first_index + block_stacks[block_class]->capacity / 2 - 1;
+        prefetches[prefetch_count].inum = inum;
+        prefetches[prefetch_count].first_index = first_index;
+        prefetches[prefetch_count].last_index = last_index;
+        prefetch_count++;
+        return;
+    }
+
+    for (index = first_index; index <= last_index; index++) {
+        block_id = GetFileBlockNumber(inode, index, &indirect_block_entry);
+        if (block_id != 0) DemoteCachedBlock(block_id);
+    }
+    if (indirect_block_entry != NULL) UnpinBlock(indirect_block_entry);
+}
+
+/*
+ * Copy a block cache partition's counters into stats
+ */
+void FillBlockCacheStats(struct FsCacheStats *stats, struct block_cache *stack) {
+    stats->capacity = stack->capacity;
+    stats->size = stack->stack_size;
+    stats->hits = stack->hits;
+    stats->misses = stack->misses;
+    stats->installs = stack->installs;
+    stats->evictions = stack->evictions;
+    stats->writebacks = stack->writebacks;
+}
+
+/*
+ * Copy the server's statistics to the client
+ */
+void GetStats(DataPacket *packet, int pid) {
+    struct FsStats stats;
+    void *pointer = packet->pointer;
+    int size = packet->arg1;
+    int i;
+
+    /* Bleach packet for reuse */
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_STATS;
+
+    /* Client was built against a different FsStats */
+    if (size != sizeof(struct FsStats)) {
+        packet->arg1 = -1;
+        return;
+    }
+
+    memset(&stats, 0, sizeof(struct FsStats));
+    FillBlockCacheStats(&stats.caches[FS_STATS_METADATA_BLOCKS], block_stacks[BLOCK_METADATA]);
+    FillBlockCacheStats(&stats.caches[FS_STATS_DATA_BLOCKS], block_stacks[BLOCK_DATA]);
+    if (pinned_blocks != NULL) FillBlockCacheStats(&stats.caches[FS_STATS_PINNED_BLOCKS], pinned_blocks);
+    stats.pinned_files = pinned_file_count;
+    stats.inode_fills = inode_stack->fills;
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        stats.prefetched += block_stacks[i]->prefetches;
+        stats.prefetch_hits += block_stacks[i]->prefetch_hits;
+        stats.prefetch_wasted += block_stacks[i]->prefetch_wasted;
+    }
+    stats.caches[FS_STATS_INODES].capacity = inode_stack->capacity;
+    stats.caches[FS_STATS_INODES].size = inode_stack->stack_size;
+    stats.caches[FS_STATS_INODES].hits = inode_stack->hits;
+    stats.caches[FS_STATS_INODES].misses = inode_stack->misses;
+    stats.caches[FS_STATS_INODES].evictions = inode_stack->evictions;
+    stats.caches[FS_STATS_INODES].writebacks = inode_stack->writebacks;
+    FillMissRatioCurve(&stats.curves[FS_STATS_METADATA_BLOCKS], block_stacks[BLOCK_METADATA]->mrc);
+    FillMissRatioCurve(&stats.curves[FS_STATS_DATA_BLOCKS], block_stacks[BLOCK_DATA]->mrc);
+    if (victim_cache != NULL) FillVictimStats(&stats.victim, victim_cache);
+    for (i = 0; i < BLOCK_CLASSES; i++) {
+        stats.sync_sectors += block_stacks[i]->total_sync_sectors;
+        stats.sync_runs += block_stacks[i]->total_sync_runs;
+    }
+    if (pinned_blocks != NULL) {
+        stats.sync_sectors += pinned_blocks->total_sync_sectors;
+        stats.sync_runs += pinned_blocks->total_sync_runs;
+    }
+    memcpy(stats.requests, request_counts, sizeof(request_counts));
+    stats.free_inodes = GetBufferCount(free_inode_list);
+    stats.free_blocks = free_extents->free_blocks;
+    stats.free_extents = free_extents->count;
+    stats.deferred_frees = deferred_free_count;
+    stats.idle_rounds = idle_rounds;
+    stats.unscanned_inodes = scan_used != NULL ? header->num_inodes - scan_next_inum + 1 : 0;
+    stats.sector_reads = disk_reads;
+    stats.sector_writes = disk_writes;
+
+    if (CopyTo(pid, pointer, &stats, sizeof(struct FsStats)) < 0) {
+        packet->arg1 = -1;
+        return;
+    }
+    packet->arg1 = 0;
+}
+
+/*
+ * Count how fragmented regular files are and copy the counts to the client,
+ * with the number of sectors counting them took
+ */
+void GetFileRunStats(DataPacket *packet, int pid) {
+    struct FsFileRuns runs;
+    void *pointer = packet->pointer;
+    int size = packet->arg1;
+    int reads = disk_reads;
+
+    /* Bleach packet for reuse */
+    memset(packet, 0, PACKET_SIZE);
+    packet->packet_type = MSG_FILE_RUNS;
+
+    /* Client was built against a different FsFileRuns */
+    if (size != sizeof(struct FsFileRuns)) {
+        packet->arg1 = -1;
+        return;
+    }
+
+    memset(&runs, 0, sizeof(struct FsFileRuns));
+    CountFileRuns(&runs);
+    runs.sector_reads = disk_reads - reads;
+
+    if (CopyTo(pid, pointer, &runs, sizeof(struct FsFileRuns)) < 0) {
+        packet->arg1 = -1;
+        return;
+    }
+    packet->arg1 = 0;
+}
+
+/**
+ * Reads server options that come before the program to exec:
+ *   yfs [-b block_cache_size] [-m metadata_cache_size] [-i inode_cache_size] [-p lru|2q|arc] [-v victim_bytes] [-r pinned_blocks] program [args...]
+ * @return Index of the program in argv, or -1 if the options are invalid
+ */
+int ParseServerOptions(int argc, char **argv) {
+    int i = 1;
+    int *target;
+    while (i < argc && argv[i][0] == '-') {
+        if (i + 1 >= argc) return -1;
+
+        if (strcmp(argv[i], "-p") == 0) {
+            if (GetReplacementPolicy(argv[i + 1]) == NULL) return -1;
+            block_cache_policy = argv[i + 1];
+            i += 2;
+            continue;
+        }
+
+        if (strcmp(argv[i], "-v") == 0) {
+            if (sscanf(argv[i + 1], "%d", &victim_cache_bytes) != 1 || victim_cache_bytes < 0) return -1;
+            i += 2;
+            continue;
+        }
+
+        if (strcmp(argv[i], "-r") == 0) {
+            if (sscanf(argv[i + 1], "%d", &pinned_cache_size) != 1 || pinned_cache_size < 0) return -1;
+            i += 2;
+            continue;
+        }
+
+        if (strcmp(argv[i], "-b") == 0) target = &block_cache_size;
+        else if (strcmp(argv[i], "-m") == 0) target = &metadata_cache_size;
+        else if (strcmp(argv[i], "-i") == 0) target = &inode_cache_size;
+        else return -1;
+
+        if (sscanf(argv[i + 1], "%d", target) != 1) return -1;
+        if (*target < MIN_CACHESIZE) return -1;
+        i += 2;
+    }
+    if (i >= argc) return -1;
+    return i;
 }
 
 int main(int argc, char **argv) {
+    int program = ParseServerOptions(argc, argv);
+    if (program < 0) {
+        fprintf(stderr, "usage: yfs [-b block_cache_size] [-m metadata_cache_size] [-i inode_cache_size] [-p lru|2q|arc] [-v victim_bytes] [-r pinned_blocks] program [args...]\n");
+        fprintf(stderr, "cache sizes must be at least %d\n", MIN_CACHESIZE);
+        return -1;
+    }
+
     Register(FILE_SERVER);
-    (void)argc;
     /* Obtain File System Header */
     void *sector_one = malloc(SECTORSIZE);
-    if (ReadSector(1, sector_one) == 0) {
-        header = (struct fs_header *)sector_one;
+    if (ReadDiskSector(1, sector_one) == 0) {
+        header = (struct fs_bitmap_header *)sector_one;
     } else {
         printf("Error\n");
     }
 
-    inode_stack = CreateInodeCache(header->num_inodes);
-    block_stack = CreateBlockCache(header->num_blocks);
-    GetFreeInodeList();
-    GetFreeBlockList();
+    inode_stack = CreateInodeCache(header->num_inodes, inode_cache_size);
+    CreateBlockCache(header->num_blocks, metadata_cache_size, GetReplacementPolicy(block_cache_policy), BLOCK_METADATA);
+    CreateBlockCache(header->num_blocks, block_cache_size, GetReplacementPolicy(block_cache_policy), BLOCK_DATA);
+    if (victim_cache_bytes > 0) CreateVictimCache(victim_cache_bytes);
+    if (pinned_cache_size > 0) CreateBlockCache(header->num_blocks, pinned_cache_size, GetReplacementPolicy("lru"), BLOCK_PINNED);
+    CreateFreeBitmaps();
+    if (block_bitmap != NULL && header->clean) {
+        LoadFreeBitmaps();
+    } else {
+        StartFreeSpaceScan();
+    }
+    SetCleanFlag(0);
+    LoadHotList();
 
     if (DEBUG) {
         printf("Printing root before starting server\n");
@@ -1241,21 +2431,44 @@ int main(int argc, char **argv) {
 
     /* Child process exec program */
     if (pid == 0) {
-        Exec(argv[1], argv + 1);
+        Exec(argv[program], argv + program);
         fprintf(stderr, "Cannot Exec.\n");
         return -1;
     }
 
     void *packet = malloc(PACKET_SIZE);
+    int type;
     while (1) {
         if ((pid = Receive(packet)) < 0) {
             fprintf(stderr, "Receive Error.\n");
             return -1;
         }
 
-        if (pid == 0) continue;
+        /* Every process is blocked, get ahead on background work */
+        if (pid == 0) {
+            idle_rounds += RunIdleWork();
+            continue;
+        }
+
+        type = ((UnknownPacket *)packet)->packet_type;
+        if (type >= 0 && type < FS_STATS_OPCODES) request_counts[type]++;
+
+        /*
+         * Requests that allocate need the free space scan to have found
+         * enough. Most creates need just an inode, the others need blocks,
+         * which are only known once the scan is done.
+         */
+        if (type == MSG_CREATE_FILE) ScanForFreeInode();
+        if (type == MSG_CREATE_DIR || type == MSG_WRITE_FILE || type == MSG_LINK) FinishFreeSpaceScan();
+
+        /* Requests that allocate may need what deleted files still hold */
+        if ((type == MSG_CREATE_FILE || type == MSG_CREATE_DIR || type == MSG_WRITE_FILE || type == MSG_LINK) &&
+            ((scan_used == NULL && free_extents->free_blocks < RESERVE_BLOCKS) || GetBufferCount(free_inode_list) == 0))
+            ReleaseDeferredFrees(deferred_free_count);
 
-        switch (((UnknownPacket *)packet)->packet_type) {
+        /* Only the handler's own lookups are demand traffic for the miss ratio curves */
+        record_lookups = 1;
+        switch (type) {
             case MSG_GET_FILE:
                 if (DEBUG) printf("MSG_GET_FILE received from pid: %d\n", pid);
                 GetFile(packet);
@@ -1292,23 +2505,50 @@ int main(int argc, char **argv) {
                 if (DEBUG) printf("MSG_UNLINK received from pid: %d\n", pid);
                 DeleteLink(packet);
                 break;
+            case MSG_PIN_FILE:
+                if (DEBUG) printf("MSG_PIN_FILE received from pid: %d\n", pid);
+                SetFilePinned(packet);
+                break;
+            case MSG_ADVISE:
+                if (DEBUG) printf("MSG_ADVISE received from pid: %d\n", pid);
+                AdviseFile(packet);
+                break;
+            case MSG_STATS:
+                if (DEBUG) printf("MSG_STATS received from pid: %d\n", pid);
+                GetStats(packet, pid);
+                break;
+            case MSG_FILE_RUNS:
+                if (DEBUG) printf("MSG_FILE_RUNS received from pid: %d\n", pid);
+                GetFileRunStats(packet, pid);
+                break;
             case MSG_SYNC:
                 if (DEBUG) printf("MSG_SYNC received from pid: %d\n", pid);
+                /* Bitmaps are only left clean once the scan has completed them */
+                if (((DataPacket *)packet)->arg1 == 1 && block_bitmap != NULL) FinishFreeSpaceScan();
                 SyncCache();
                 if (((DataPacket *)packet)->arg1 == 1) {
+                    SaveHotList();
+                    SetCleanFlag(1);
                     Reply(packet, pid);
                     printf("Shutdown by pid: %d. Bye bye!\n", pid);
                     Exit(0);
                 }
                 break;
             default:
+                record_lookups = 0;
                 continue;
         }
+        record_lookups = 0;
 
         if (Reply(packet, pid) < 0) {
             fprintf(stderr, "Reply Error.\n");
             return -1;
         }
+
+        /* The client is running again, write back before misses have to */
+        FlushDirtyBlocks(block_stacks[BLOCK_METADATA]);
+        FlushDirtyBlocks(block_stacks[BLOCK_DATA]);
+        RunPrefetches(PREFETCH_CHUNK);
     }
 
     return 0;
@@ -0,0 +1,103 @@
+/*
+ * Prints the file server's statistics, see fsstats.h
+ */
+
+#include <stdio.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+#include <comp421/filesystem.h>
+#include "fsstats.h"
+
+#define KNEE_PERCENT 1.0 /* Hit rate a recommended size may give up */
+
+char *cache_names[FS_STATS_CACHES] = {"metadata", "data", "inode", "pinned"};
+
+char *partition_options[FS_STATS_DATA_BLOCKS + 1] = {"-m", "-b"};
+
+char *request_names[FS_STATS_OPCODES] = {
+    "get", "search", "create", "read", "write", "mkdir", "rmdir", "link", "unlink", "sync", "stats", "pin", "advise", "fileruns"
+};
+
+/*
+ * Prints a partition's estimated hit rate at each size and recommends the
+ * smallest size within KNEE_PERCENT of the best rate the curve reaches
+ */
+void
+PrintCurve(int partition, struct FsCacheStats *cache, struct FsMissRatioCurve *curve)
+{
+    double rate;
+    double best;
+    int recommended = 0;
+    int i;
+
+    if (curve->accesses == 0) return;
+    best = 100.0 * curve->hits[FS_STATS_MRC_POINTS - 1] / curve->accesses;
+
+    printf("%s partition, estimated LRU hit rate over %d lookups:\n", cache_names[partition], curve->accesses);
+    for (i = 0; i < FS_STATS_MRC_POINTS; i++) {
+	rate = 100.0 * curve->hits[i] / curve->accesses;
+	if (recommended == 0 && rate >= best - KNEE_PERCENT)
+	    recommended = (i + 1) * curve->bucket_blocks;
+	printf("  %6d blocks %6.1f%%%s\n", (i + 1) * curve->bucket_blocks, rate,
+	    (i + 1) * curve->bucket_blocks == cache->capacity ? "  <- current" : "");
+    }
+    printf("  recommended size: %s %d\n", partition_options[partition], recommended);
+}
+
+int
+main()
+{
+    struct FsStats stats;
+    struct FsFileRuns runs;
+    int i;
+
+    if (GetFsStats(&stats) < 0) {
+	fprintf(stderr, "yfsstat: cannot get statistics\n");
+	return 1;
+    }
+
+    printf("%-10s %8s %8s %8s %8s %8s %10s %10s\n", "cache", "capacity", "size", "hits", "misses", "installs", "evictions", "writebacks");
+    for (i = 0; i < FS_STATS_CACHES; i++) {
+	printf("%-10s %8d %8d %8d %8d %8d %10d %10d\n", cache_names[i],
+	    stats.caches[i].capacity, stats.caches[i].size, stats.caches[i].hits, stats.caches[i].misses,
+	    stats.caches[i].installs, stats.caches[i].evictions, stats.caches[i].writebacks);
+    }
+
+    PrintCurve(FS_STATS_METADATA_BLOCKS, &stats.caches[FS_STATS_METADATA_BLOCKS], &stats.curves[FS_STATS_METADATA_BLOCKS]);
+    PrintCurve(FS_STATS_DATA_BLOCKS, &stats.caches[FS_STATS_DATA_BLOCKS], &stats.curves[FS_STATS_DATA_BLOCKS]);
+
+    if (stats.victim.budget > 0) {
+	printf("victim tier: %d of %d bytes in %d blocks, %d of %d lookups hit",
+	    stats.victim.used, stats.victim.budget, stats.victim.blocks, stats.victim.hits, stats.victim.lookups);
+	if (stats.victim.admitted_bytes > 0)
+	    printf(", compression %.1f:1", (double)stats.victim.admitted * BLOCKSIZE / stats.victim.admitted_bytes);
+	printf(", %d rejected\n", stats.victim.rejected);
+    }
+
+    printf("sectors read %d, written %d\n", stats.sector_reads, stats.sector_writes);
+    printf("sync wrote %d sectors in %d runs\n", stats.sync_sectors, stats.sync_runs);
+    printf("free inodes %d, free blocks %d in %d runs, deleted files not yet freed %d, pinned files %d\n",
+	stats.free_inodes, stats.free_blocks, stats.free_extents, stats.deferred_frees, stats.pinned_files);
+    if (stats.unscanned_inodes > 0)
+	printf("free space scan still running, %d inodes left, free blocks not counted yet\n", stats.unscanned_inodes);
+    printf("idle rounds of background work %d\n", stats.idle_rounds);
+    printf("inodes cached alongside a missed inode %d\n", stats.inode_fills);
+    printf("blocks prefetched %d, used %d, evicted unused %d\n", stats.prefetched, stats.prefetch_hits, stats.prefetch_wasted);
+
+    printf("requests:");
+    for (i = 0; i < FS_STATS_OPCODES; i++) {
+	if (stats.requests[i] == 0) continue;
+	if (request_names[i] != NULL) printf(" %s %d", request_names[i], stats.requests[i]);
+	else printf(" type%d %d", i, stats.requests[i]);
+    }
+    printf("\n");
+
+    /* Asked for last, its reads would otherwise show in the counts above */
+    if (GetFsFileRuns(&runs) == 0 && runs.file_runs > 0)
+	printf("%d files hold %d blocks in %d runs, %.2f runs per file, %.2f blocks per run, %d sectors read to count\n",
+	    runs.files, runs.file_blocks, runs.file_runs,
+	    (double)runs.file_runs / runs.files, (double)runs.file_blocks / runs.file_runs, runs.sector_reads);
+
+    return 0;
+}